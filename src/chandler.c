@@ -20,36 +20,72 @@
 #define _DEFAULT_SOURCE
 
 #include "chandler_conf.h"
+#include "chandler_ctl.h"
+#include "chandler_event.h"
 #include "chandler_log.h"
+#include "chandler_loop.h"
+#include "chandler_metrics.h"
 #include "chandler_ovs.h"
 #include "chandler_ovs_db.h"
+#include "chandler_prom.h"
+#include "chandler_spawner.h"
 #include "chandler_stat.h"
+#include "chandler_state.h"
 #include "chandler_system.h"
+#include "chandler_timer.h"
 
 #include <errno.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/poll.h>
+#include <signal.h>
+#include <sys/wait.h>
 #include <unistd.h>
 
-#define OUTPUT_BUFFER_SIZE  4096
+#define OUTPUT_BUFFER_SIZE        4096
+#define MONITOR_RETRY_DELAY_MSEC  1000
 
-static volatile int is_interrupted = 0;
+/* Hook command started asynchronously, it is reaped on SIGCHLD */
+typedef struct hook_t {
+    const char    *name;
+    pid_t          pid;            // 0 - hook is not running
+    int            output_fd;
+    uint64_t       start_time;
+    wheel_timer_t  timeout;
+} hook_t;
 
-static void sig_int_handler(int value)
-{
-    (void)value;
-    fprintf(stderr, "\n-- received SIGINT\n");
-    is_interrupted = 1;
-}
+static int  is_check_requested = 0;
+
+static wheel_timer_t check_timer;
+
+static long check_delay = 0;          // current interval between checks in msec
+
+static wheel_timer_t sample_timer;    // interval of daemons resource usage sampling
+
+static wheel_timer_t monitor_timer;   // delay before reconnect or interval of echo requests
+
+static ovsdb_monitor_t db_monitor = {.fd = -1};
+
+static hook_t hook_disconnect = {.name = "disconnect", .output_fd = -1};
+static hook_t hook_reboot     = {.name = "reboot",     .output_fd = -1};
+static hook_t hook_slow       = {.name = "slow",       .output_fd = -1};
+static hook_t hook_remediate  = {.name = "remediate",  .output_fd = -1};
+
+static char conf_path[MAX_PATH_SIZE] = "";
+
+/* Totals loaded from the state file, restarts and failures with no window are counted since start */
+static long restarts_at_start = 0;
+static long failures_at_start = 0;
+
+/* Changes made by configuration reloads, which are not applied yet */
+static conf_changes_t pending_changes = {0};
 
 void print_usage(void)
 {
     printf("Usage:\n");
     printf("    chandler -h\n");
-    printf("    chandler [-c FILE] [-l LEVEL] [-f NAME [-r COUNT] [-m SIZE]] [-s] \n");
+    printf("    chandler [-c FILE] [-l LEVEL] [-f NAME [-r COUNT] [-m SIZE] [-b SIZE]] [-s] [-y]\n");
     printf("Where:\n");
     printf("    -c FILE - load configuration from FILE (FILE can contain a full path, max length is %d)\n", MAX_PATH_SIZE - 1);
     printf("    -h - print this page\n");
@@ -60,22 +96,24 @@ void print_usage(void)
     printf("        4 - debug\n");
     printf("    -f NAME - log file name (may be including full path, max length is %d)\n", MAX_LOG_FILE_PATH_SIZE - 1);
     printf("    -s - silent mode - no console output\n");
+    printf("    -y - send log records to syslog (%s)\n", SYSLOG_SOCKET_PATH);
     printf("    -r COUNT - rotation file count (1 <= count <= 9, default is 1)\n");
     printf("    -m SIZE - log file size limit in bytes (max is %d (used by default), min is %d)\n", MAX_LOG_FILE_SIZE, MIN_LOG_FILE_SIZE);
+    printf("    -b SIZE - keep file records in memory ring of SIZE bytes and write them only on incidents\n");
+    printf("        (max is %d, min is %d, disabled by default)\n", MAX_LOG_RING_SIZE, MIN_LOG_RING_SIZE);
 }
 
 int configure(int argc, char * argv[])
 {
     int             rc;
     int             opt;
-    char            conf_path[MAX_PATH_SIZE] = "";
     long            log_level;
     chandler_log_conf_t *log_conf = chandler_log_conf();
     char           *end;
 
     do
     {
-        opt = getopt(argc, argv, "hc:l:sf:r:m:");
+        opt = getopt(argc, argv, "hc:l:sf:r:m:b:y");
         switch (opt)
         {
         case -1:
@@ -105,6 +143,9 @@ int configure(int argc, char * argv[])
         case 's':
             log_conf->log_to_console = 0;
             break;
+        case 'y':
+            log_conf->log_to_syslog = 1;
+            break;
         case 'f':
             if (strlen(optarg) >= sizeof(log_conf->file_name))
             {
@@ -133,6 +174,15 @@ int configure(int argc, char * argv[])
                 return 2;
             }
             break;
+        case 'b':
+            log_conf->ring_size = strtol(optarg, &end, 0);
+            if (*end != '\0' || log_conf->ring_size > MAX_LOG_RING_SIZE || log_conf->ring_size < MIN_LOG_RING_SIZE)
+            {
+                fprintf(stderr, "log ring size is invalid: %s\n", optarg);
+                print_usage();
+                return 2;
+            }
+            break;
         default:
             print_usage();
             return 2;
@@ -151,84 +201,519 @@ int configure(int argc, char * argv[])
 
     /* Overriding configuration from environment if any */
     load_conf_env();
+    add_legacy_services();
     return 0;
 }
 
-static int on_disconnect(void)
+static void on_check_now(void)
 {
-    FILE   *output;
-    char    output_buffer[OUTPUT_BUFFER_SIZE] = "";
-    size_t  count = 0;
+    is_check_requested = 1;
+}
+
+static int on_reload(void)
+{
+    conf_changes_t changes;
+
+    LOG_INFO("reloading configuration");
 
+    if (reload_conf(conf_path, &changes) != 0) {
+        return -1;
+    }
+
+    pending_changes.mask |= changes.mask;
+    return 0;
+}
+
+static void restart_listener(const char * name, const char * sock_path, void (* done)(void), int (* init)(const char *))
+{
+    done();
+    if (init(sock_path)) {
+        LOG_ERROR("failed to restart %s on \"%s\"", name, sock_path);
+    }
+}
+
+static const ctl_handlers_t ctl_handlers = {
+    .on_check_now = on_check_now,
+    .on_reload    = on_reload
+};
+
+static int ctl_restart(const char * sock_path)
+{
+    return ctl_init(sock_path, &ctl_handlers);
+}
+
+static void on_hook_output(int fd, uint32_t events, void * ctx)
+{
+    hook_t  *hook = ctx;
+    char     output_buffer[OUTPUT_BUFFER_SIZE];
+    ssize_t  count;
+
+    (void)events;
+
+    count = read(fd, output_buffer, sizeof(output_buffer) - 1);
+    if (count > 0) {
+        output_buffer[count] = '\0';
+        LOG_DBG("-- %s", output_buffer);
+        return;
+    }
+
+    if (count < 0 && (errno == EAGAIN || errno == EINTR)) {
+        return;
+    }
+
+    loop_del_fd(fd);
+    close(fd);
+    hook->output_fd = -1;
+}
+
+static void on_hook_timeout(void * ctx)
+{
+    hook_t *hook = ctx;
+
+    LOG_ERROR("%s command has not finished in %ld msec - killing it", hook->name, get_conf()->hook_timeout);
+
+    /* the shell is a process group leader, so its children are killed too */
+    if (kill(-hook->pid, SIGKILL)) {
+        LOG_ERROR("failed to kill %s command: %d (%s)", hook->name, errno, strerror(errno));
+    }
+}
+
+/* Returns 1 if the exited child was the hook */
+static int hook_on_exit(hook_t * hook, pid_t pid, int status)
+{
+    if (hook->pid != pid) {
+        return 0;
+    }
+
+    wheel_timer_cancel(&hook->timeout);
+    hook->pid = 0;
+
+    metric_observe(metric_register(MT_HISTOGRAM, "chandler_hook_runtime_usec", "Run time of hook commands", "hook", hook->name),
+                   time_monotonic_usec() - hook->start_time);
+
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        LOG_WARN("%s command has failed with status %d", hook->name, status);
+    }
+    else {
+        LOG_INFO("%s command has finished", hook->name);
+    }
+
+    return 1;
+}
+
+/* Starts the hook command unless it is still running, its output is logged from the event loop */
+static int run_hook(hook_t * hook, const char * command)
+{
+    if (hook->pid > 0) {
+        LOG_WARN("%s command is still running", hook->name);
+        return 0;
+    }
+
+    hook->pid = spawn_shell(command, &hook->output_fd);
+    if (hook->pid == -1) {
+        LOG_ERROR("failed to invoke %s command \"%s\": %d (%s)", hook->name, command, errno, strerror(errno));
+        hook->pid = 0;
+        return -1;
+    }
+
+    LOG_WARN("invoked %s command \"%s\"", hook->name, command);
+
+    hook->start_time = time_monotonic_usec();
+
+    if (loop_add_fd(hook->output_fd, EPOLLIN, on_hook_output, hook)) {
+        close(hook->output_fd);
+        hook->output_fd = -1;
+    }
+
+    wheel_timer_start(&hook->timeout, get_conf()->hook_timeout, on_hook_timeout, hook);
+    return 0;
+}
+
+static int on_disconnect(void)
+{
     LOG_WARN("received disconnect notification");
+    chandler_log_incident();
+    event_emit(EV_DISCONNECT, NULL, "controller is not connected");
 
     if (get_conf()->ovs_cmd_disconnect[0] == '\0') {
         return 0;
     }
 
-    output = popen(get_conf()->ovs_cmd_disconnect, "r");
-    if (output == NULL) {
-        LOG_ERROR("failed to invoke disconnect command \"%s\": %d (%s)", get_conf()->ovs_cmd_disconnect, errno, strerror(errno));
-        return -1;
+    return run_hook(&hook_disconnect, get_conf()->ovs_cmd_disconnect);
+}
+
+/* Degradation is reported once when RTTs cross the thresholds and once when they are back */
+static void on_slow(const char * target, int is_slow, const char * detail)
+{
+    if (!is_slow) {
+        LOG_INFO("%s is responsive again: %s", target, detail);
+        return;
     }
 
-    LOG_WARN("invoked disconnect command \"%s\"", get_conf()->ovs_cmd_disconnect);
+    LOG_WARN("%s is getting slow: %s", target, detail);
+    chandler_log_incident();
+    event_emit(EV_SLOW, target, detail);
 
-    do {
-        count = fread(output_buffer, 1, sizeof(output_buffer) - 1, output);
-        output_buffer[count] = '\0';
-        LOG_DBG("-- %s", output_buffer);
-    } while (count == sizeof(output_buffer) - 1);
+    if (get_conf()->ovs_cmd_slow[0] != '\0') {
+        run_hook(&hook_slow, get_conf()->ovs_cmd_slow);
+    }
+}
 
-    return pclose(output);
+/* Returns number of events within the window, or since start if the window is 0 */
+static long recent_count(const stat_window_t * window, long total, long window_msec)
+{
+    if (window_msec <= 0) {
+        return total;
+    }
+
+    return stat_window_count(window, time_realtime_usec(), (uint64_t)window_msec * 1000);
 }
 
 static int reboot(void)
 {
-    FILE   *output;
-    char    output_buffer[OUTPUT_BUFFER_SIZE] = "";
-    size_t  count = 0;
-
     if (get_conf()->ovs_cmd_reboot[0] == '\0') {
         return system_reboot();
     }
 
-    LOG_WARN("invoking reboot command \"%s\"", get_conf()->ovs_cmd_reboot);
+    return run_hook(&hook_reboot, get_conf()->ovs_cmd_reboot);
+}
 
-    output = popen(get_conf()->ovs_cmd_reboot, "r");
-    if (output == NULL) {
-        LOG_ERROR("failed to invoke reboot command \"%s\": %d (%s)", get_conf()->ovs_cmd_reboot, errno, strerror(errno));
-        return -1;
+/*
+ * Reboots are counted in the state file, so a reboot loop is broken by
+ * max_reboots even if each reboot starts a fresh chandler.
+ */
+static void request_reboot(const char * reason)
+{
+    long reboots = recent_count(&chandler_stat()->recent_reboots, chandler_stat()->reboots_count, get_conf()->reboots_window);
+
+    if (get_conf()->max_reboots && reboots >= get_conf()->max_reboots) {
+        LOG_ERROR("reboot loop detected: %ld reboots within %ld msec - not rebooting", reboots, get_conf()->reboots_window);
+        chandler_log_incident();
+        event_emit(EV_REBOOT, NULL, "suppressed, reboot loop is detected");
+        return;
     }
 
-    do {
-        count = fread(output_buffer, 1, sizeof(output_buffer) - 1, output);
-        output_buffer[count] = '\0';
-        LOG_DBG("-- %s", output_buffer);
-    } while (count == sizeof(output_buffer) - 1);
+    LOG_WARN("rebooting the system...");
+    chandler_log_incident();
+    event_emit(EV_REBOOT, NULL, reason);
+
+    /*
+     * The state has to reach the disk before the system goes down. Restarts
+     * and failures which have led to the reboot are forgotten, otherwise the
+     * next chandler would find them within the window and reboot again.
+     */
+    chandler_stat()->reboots_count += 1;
+    stat_window_add(&chandler_stat()->recent_reboots, time_realtime_usec());
+    memset(&chandler_stat()->recent_restarts, 0, sizeof(chandler_stat()->recent_restarts));
+    memset(&chandler_stat()->recent_failures, 0, sizeof(chandler_stat()->recent_failures));
+    state_update();
+
+    if (reboot()) {
+        LOG_ERROR("failed to reboot the system: %d (%s)", errno, strerror(errno));
+    }
+}
+
+/*
+ * Reboot is requested once when restarts or failures exceed their limits and
+ * is not repeated until the counts drop below the limits.
+ */
+static void check_reboot_policy(void)
+{
+    static int is_handled = 0;
+
+    long restarts = recent_count(&chandler_stat()->recent_restarts, chandler_stat()->restarts_count - restarts_at_start - ovs_planned_restarts(), get_conf()->restarts_window);
+    long failures = recent_count(&chandler_stat()->recent_failures, chandler_stat()->failures_count - failures_at_start, get_conf()->failures_window);
+
+    if (   !(get_conf()->restarts_before_reboot && (restarts > get_conf()->restarts_before_reboot))
+        && !(get_conf()->failures_before_reboot && (failures > get_conf()->failures_before_reboot))
+    )
+    {
+        is_handled = 0;
+        return;
+    }
+
+    if (is_handled) {
+        return;
+    }
+
+    is_handled = 1;
+
+    LOG_INFO("restarts count: %ld within %ld msec (max: %ld)", restarts, get_conf()->restarts_window, get_conf()->restarts_before_reboot);
+    LOG_INFO("failures count: %ld within %ld msec (max: %ld)", failures, get_conf()->failures_window, get_conf()->failures_before_reboot);
+
+    request_reboot("restarts or failures limit is exceeded");
+}
+
+/* Steps of the escalation ladder which are not about daemons, the failed daemon is restarted anyway */
+static void on_escalation(escalation_action_t action)
+{
+    if (action == EA_REBOOT) {
+        request_reboot("escalation ladder has reached reboot");
+        return;
+    }
 
-    return pclose(output);
+    if (get_conf()->ovs_cmd_remediate[0] == '\0') {
+        LOG_WARN("no remediation command is configured");
+        return;
+    }
+
+    run_hook(&hook_remediate, get_conf()->ovs_cmd_remediate);
+}
+
+static void on_check_timer(void * ctx);
+
+/* Randomizes the delay by check_jitter percent, so that checks of many hosts do not synchronize */
+static long jittered(long delay)
+{
+    long span = delay * get_conf()->check_jitter / 100;
+
+    if (span <= 0) {
+        return delay;
+    }
+
+    return delay - span + random() % (2 * span + 1);
+}
+
+static void schedule_check(void)
+{
+    wheel_timer_start(&check_timer, jittered(check_delay), on_check_timer, NULL);
+}
+
+/* Checks are repeated with recheck_interval after any anomaly */
+static void on_anomaly(void)
+{
+    if (check_delay != get_conf()->recheck_interval) {
+        LOG_INFO("switching to %ld msec check interval", get_conf()->recheck_interval);
+        check_delay = get_conf()->recheck_interval;
+        schedule_check();
+    }
+}
+
+/*
+ * Interval is doubled after every check finding daemons healthy, up to
+ * check_interval. Results of the checks arrive later, so the decision is
+ * based on the previous round.
+ */
+static void on_check_timer(void * ctx)
+{
+    (void)ctx;
+    LOG_DBG("-- timer");
+
+    if (ovs_is_healthy()) {
+        check_delay = (check_delay > get_conf()->check_interval / 2)? get_conf()->check_interval: check_delay * 2;
+    }
+    else {
+        check_delay = get_conf()->recheck_interval;
+    }
+
+    if (check_delay <= 0) {
+        check_delay = get_conf()->check_interval;
+    }
+
+    check_ovs();
+    schedule_check();
+}
+
+static void on_sample_timer(void * ctx)
+{
+    (void)ctx;
+
+    ovs_sample();
+
+    if (get_conf()->sample_interval > 0) {
+        wheel_timer_start(&sample_timer, get_conf()->sample_interval, on_sample_timer, NULL);
+    }
+}
+
+static const ovs_handlers_t ovs_handlers = {
+    .on_anomaly    = on_anomaly,
+    .on_slow       = on_slow,
+    .on_escalation = on_escalation
+};
+
+static void on_monitor_event(int fd, uint32_t events, void * ctx);
+
+static void monitor_connect(void * ctx);
+
+static void monitor_reconnect_later(void)
+{
+    if (db_monitor.fd != -1) {
+        loop_del_fd(db_monitor.fd);
+        monitor_destroy(&db_monitor);
+    }
+
+    wheel_timer_start(&monitor_timer, MONITOR_RETRY_DELAY_MSEC, monitor_connect, NULL);
+}
+
+static void on_monitor_echo(void * ctx)
+{
+    (void)ctx;
+
+    /* the previous echo has been answered, so its RTT is already counted */
+    ovs_check_slow(&db_monitor.rtts, "ovsdb-server");
+
+    if (QS_SUCCESS != monitor_echo(&db_monitor)) {
+        LOG_WARN("destroying ovsdb monitor");
+        monitor_reconnect_later();
+        return;
+    }
+
+    wheel_timer_start(&monitor_timer, get_conf()->echo_interval, on_monitor_echo, NULL);
+}
+
+static void monitor_connect(void * ctx)
+{
+    (void)ctx;
+
+    switch (monitor_create(get_conf()->ovs_unixsock_db, &db_monitor, on_disconnect))
+    {
+    case QS_SUCCESS:
+        if (loop_add_fd(db_monitor.fd, EPOLLIN, on_monitor_event, &db_monitor)) {
+            monitor_destroy(&db_monitor);
+            break;
+        }
+
+        LOG_INFO("created ovsdb monitor");
+        if (get_conf()->echo_interval > 0) {
+            wheel_timer_start(&monitor_timer, get_conf()->echo_interval, on_monitor_echo, NULL);
+        }
+        return;
+    default:
+        LOG_ERROR("failed to create ovsdb monitor");
+    }
+
+    wheel_timer_start(&monitor_timer, MONITOR_RETRY_DELAY_MSEC, monitor_connect, NULL);
+}
+
+static void on_monitor_event(int fd, uint32_t events, void * ctx)
+{
+    ovsdb_monitor_t *monitor = ctx;
+
+    (void)fd;
+    (void)events;
+
+    LOG_DBG("-- ovsdb monitor event");
+    if (monitor->on_read != NULL) {
+        if (QS_SUCCESS != monitor->on_read(monitor)) {
+            LOG_WARN("destroying ovsdb monitor");
+            monitor_reconnect_later();
+        }
+    }
+}
+
+/*
+ * Applies only what has been changed by reload: connections, counters and
+ * timers unrelated to the changed values are kept.
+ */
+static void apply_conf_changes(void)
+{
+    conf_changes_t changes = pending_changes;
+
+    pending_changes.mask = 0;
+
+    if (is_conf_changed(&changes, &get_conf()->check_interval)) {
+        if (check_delay > get_conf()->check_interval) {
+            check_delay = get_conf()->check_interval;
+            schedule_check();
+        }
+        LOG_INFO("check interval is limited to %ld msec", get_conf()->check_interval);
+    }
+
+    if (is_conf_changed(&changes, &get_conf()->sample_interval)) {
+        wheel_timer_cancel(&sample_timer);
+        if (get_conf()->sample_interval > 0) {
+            wheel_timer_start(&sample_timer, get_conf()->sample_interval, on_sample_timer, NULL);
+        }
+        LOG_INFO("sample interval is set to %ld msec", get_conf()->sample_interval);
+    }
+
+    if (is_conf_changed(&changes, get_conf()->ovs_unixsock_db)) {
+        LOG_INFO("re-subscribing ovsdb monitor");
+        if (db_monitor.fd != -1) {
+            loop_del_fd(db_monitor.fd);
+            monitor_destroy(&db_monitor);
+        }
+        wheel_timer_start(&monitor_timer, 0, monitor_connect, NULL);
+    }
+
+    if (is_conf_changed(&changes, get_conf()->prom_unixsock)) {
+        restart_listener("metrics exporter", get_conf()->prom_unixsock, prom_done, prom_init);
+    }
+
+    if (is_conf_changed(&changes, get_conf()->ctl_unixsock)) {
+        restart_listener("control socket", get_conf()->ctl_unixsock, ctl_done, ctl_restart);
+    }
+
+    if (is_conf_changed(&changes, get_conf()->event_unixsock)) {
+        restart_listener("event stream", get_conf()->event_unixsock, event_done, event_init);
+    }
+
+    /* a new file would count the current boot once more, so it is switched only at startup */
+    if (is_conf_changed(&changes, get_conf()->state_file)) {
+        LOG_WARN("state_file change takes effect after chandler is restarted");
+    }
+}
+
+static void on_terminate(const struct signalfd_siginfo * info, void * ctx)
+{
+    (void)ctx;
+    LOG_INFO("received %s", info->ssi_signo == SIGINT? "SIGINT": "SIGTERM");
+    loop_stop();
+}
+
+static void on_hangup(const struct signalfd_siginfo * info, void * ctx)
+{
+    (void)info;
+    (void)ctx;
+    LOG_INFO("received SIGHUP");
+    on_reload();
+}
+
+/* Reaps all exited children: signals are merged, so one SIGCHLD may stand for several of them */
+static void on_child(const struct signalfd_siginfo * info, void * ctx)
+{
+    pid_t pid;
+    int   status;
+
+    (void)info;
+    (void)ctx;
+
+    while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+        if (   hook_on_exit(&hook_disconnect, pid, status)
+            || hook_on_exit(&hook_reboot, pid, status)
+            || hook_on_exit(&hook_slow, pid, status)
+            || hook_on_exit(&hook_remediate, pid, status)
+            || ovs_on_child_exit(pid, status)
+            || spawner_on_exit(pid)
+        )
+        {
+            continue;
+        }
+
+        if (WIFEXITED(status)) {
+            LOG_DBG("child %d has exited with status %d", pid, WEXITSTATUS(status));
+        }
+        else if (WIFSIGNALED(status)) {
+            LOG_DBG("child %d has been killed by signal %d", pid, WTERMSIG(status));
+        }
+    }
 }
 
 int main(int argc, char * argv[])
 {
     int             rc;
-    struct pollfd   fds[2] = {{.fd = -1, .events = POLLIN}, {.fd = -1, .events = POLLIN}};
-    int             fd_count = 2;
-    ovsdb_monitor_t db_monitor;
-    uint64_t        exp;
+    int             spawner_rc;
 
     setlinebuf(stdout);
 
-    signal(SIGINT,  sig_int_handler);
-    signal(SIGCHLD, SIG_IGN);
-    signal(SIGHUP,  SIG_IGN);
-
     rc = configure(argc, argv);
     if (rc) {
         return rc;
     }
 
+    /* the helper is forked while chandler is still small */
+    spawner_rc = spawner_init();
+
     if (!chandler_log_init()) {
         fprintf(stderr, "failed to initialize logger - aborting\n");
         return 1;
@@ -236,84 +721,95 @@ int main(int argc, char * argv[])
 
     LOG_DBG("started");
 
-    fds[0].fd = timer_create_repeated(get_conf()->check_interval);
-    if (fds[0].fd == -1) {
-        LOG_ERROR("failed to create timer: %d (%s)", errno, strerror(errno));
+    if (spawner_rc) {
+        LOG_WARN("failed to start spawn helper: %d (%s) - daemons are forked by chandler", spawner_rc, strerror(spawner_rc));
+    }
+
+    metrics_init();
+
+    /* chandler keeps working without the saved state, only reboot loops are not detected */
+    state_open(get_conf()->state_file);
+    restarts_at_start = chandler_stat()->restarts_count;
+    failures_at_start = chandler_stat()->failures_count;
+
+    if (loop_init()) {
+        LOG_ERROR("failed to initialize event loop");
         return 1;
     }
 
-    LOG_INFO("created timer with %ld msec interval", get_conf()->check_interval);
+    /* All signals are handled synchronously by the loop */
+    if (   loop_add_signal(SIGINT,  on_terminate, NULL)
+        || loop_add_signal(SIGTERM, on_terminate, NULL)
+        || loop_add_signal(SIGHUP,  on_hangup,    NULL)
+        || loop_add_signal(SIGCHLD, on_child,     NULL)
+    )
+    {
+        LOG_ERROR("failed to set up signal handling");
+        return 1;
+    }
 
-    while (!is_interrupted) {
-        if (fds[1].fd == -1) {
-            switch (monitor_create(get_conf()->ovs_unixsock_db, &db_monitor, on_disconnect))
-            {
-            case QS_SUCCESS:
-                LOG_INFO("created ovsdb monitor");
-                fds[1].fd = db_monitor.fd;
-                fd_count = 2;
-                break;
-            default:
-                LOG_ERROR("failed to create ovsdb monitor");
-                fd_count = 1;
-            }
-        }
+    if (prom_init(get_conf()->prom_unixsock)) {
+        LOG_ERROR("failed to start metrics exporter on \"%s\"", get_conf()->prom_unixsock);
+        return 1;
+    }
 
-        rc = poll(fds, fd_count, -1);
-        if (rc == -1)
-        {
-            LOG_ERROR("poll failed: %d", rc);
-            continue;
-        }
+    if (ctl_init(get_conf()->ctl_unixsock, &ctl_handlers)) {
+        LOG_ERROR("failed to start control socket on \"%s\"", get_conf()->ctl_unixsock);
+        return 1;
+    }
 
-        if (rc == 0)
-        {
-            LOG_ERROR("poll timeout");
-            continue;
-        }
+    if (event_init(get_conf()->event_unixsock)) {
+        LOG_ERROR("failed to start event stream on \"%s\"", get_conf()->event_unixsock);
+        return 1;
+    }
 
-        if (((unsigned short)fds[0].revents & (unsigned short)POLLIN))
-        {
-            LOG_DBG("-- timer");
-            fds[0].revents = 0;
-            if (sizeof(exp) != read(fds[0].fd, &exp, sizeof(exp))) {
-                LOG_ERROR("failed to reset timer descriptor");
-            }
-            check_ovs();
-        }
+    if (wheel_init()) {
+        LOG_ERROR("failed to create timer: %d (%s)", errno, strerror(errno));
+        return 1;
+    }
 
-        if (((unsigned short)fds[1].revents & (unsigned short)POLLIN))
-        {
-            LOG_DBG("-- ovsdb monitor event");
-            fds[1].revents = 0;
-            if (db_monitor.on_read != NULL) {
-                if (QS_SUCCESS != db_monitor.on_read(&db_monitor)) {
-                    sleep(1);
-                    LOG_WARN("destroying ovsdb monitor");
-                    monitor_destroy(&db_monitor);
-                    fds[1].fd = -1;
-                    fd_count = 1;
-                }
-            }
+    /* the first check is made right away */
+    srandom((unsigned)(getpid() ^ time_monotonic_usec()));
+    ovs_set_handlers(&ovs_handlers);
+    check_delay = get_conf()->recheck_interval;
+    wheel_timer_start(&check_timer, 0, on_check_timer, NULL);
+    LOG_INFO("checking daemons every %ld..%ld msec", get_conf()->recheck_interval, get_conf()->check_interval);
+
+    if (get_conf()->sample_interval > 0) {
+        wheel_timer_start(&sample_timer, get_conf()->sample_interval, on_sample_timer, NULL);
+    }
+
+    monitor_connect(NULL);
+
+    while (!loop_is_stopped()) {
+        if (pending_changes.mask) {
+            apply_conf_changes();
         }
 
-        if (   (get_conf()->restarts_before_reboot && (chandler_stat()->restarts_count > get_conf()->restarts_before_reboot))
-            || (get_conf()->failures_before_reboot && (chandler_stat()->failures_count > get_conf()->failures_before_reboot))
-        )
-        {
-            LOG_INFO("restarts count: %ld (max: %ld)", chandler_stat()->restarts_count, get_conf()->restarts_before_reboot);
-            LOG_INFO("failures count: %ld (max: %ld)", chandler_stat()->failures_count, get_conf()->failures_before_reboot);
+        loop_run_once(-1);
 
-            LOG_WARN("rebooting the system...");
-            if (reboot()) {
-                LOG_ERROR("failed to reboot the system: %d (%s)", errno, strerror(errno));
-            }
+        if (is_check_requested) {
+            is_check_requested = 0;
+            check_ovs();
         }
+
+        check_reboot_policy();
+        state_update();
+        chandler_log_flush();
     }
 
-    monitor_destroy(&db_monitor);
-    timer_destroy(fds[0].fd);
+    event_done();
+    ctl_done();
+    prom_done();
+    if (db_monitor.fd != -1) {
+        loop_del_fd(db_monitor.fd);
+        monitor_destroy(&db_monitor);
+    }
+    wheel_done();
+    loop_done();
 
+    spawner_done();
+    state_close();
     chandler_log_done();
 
     return 0;
@@ -0,0 +1,317 @@
+/*
+################################################################################
+#
+#  Copyright 2020-2021 Inango Systems Ltd.
+#
+#  Licensed under the Apache License, Version 2.0 (the "License");
+#  you may not use this file except in compliance with the License.
+#  You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+#  Unless required by applicable law or agreed to in writing, software
+#  distributed under the License is distributed on an "AS IS" BASIS,
+#  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+#  See the License for the specific language governing permissions and
+#  limitations under the License.
+#
+################################################################################
+*/
+#define _GNU_SOURCE
+
+#include "chandler_cgroup.h"
+
+#include "chandler_log.h"
+#include "chandler_loop.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+#define CGROUP_FILE_SIZE      512
+#define CGROUP_FILE_NAME_SIZE 32             // space for a file name appended to the cgroup path
+#define CGROUP_CONTROLLERS    "+memory +cpu"
+
+
+static int       g_inotify_fd = -1;
+static cgroup_t *g_cgroups[MAX_CGROUPS];     // open cgroups, looked up by watch descriptors
+static size_t    g_cgroups_count = 0;
+
+static const char * const limit_files[] = {"memory.high", "memory.max", "cpu.max"};
+
+
+static int cgroup_write(const char * dir, const char * file, const char * value)
+{
+    char path[MAX_PATH_SIZE + CGROUP_FILE_NAME_SIZE];
+    int  fd;
+    int  rc = 0;
+
+    snprintf(path, sizeof(path), "%s/%s", dir, file);
+
+    fd = open(path, O_WRONLY | O_CLOEXEC);
+    if (fd < 0 || write(fd, value, strlen(value)) < 0) {
+        rc = errno;
+    }
+
+    if (fd >= 0) {
+        close(fd);
+    }
+
+    return rc;
+}
+
+static int cgroup_read(const char * dir, const char * file, char * buffer, size_t size)
+{
+    char    path[MAX_PATH_SIZE + CGROUP_FILE_NAME_SIZE];
+    int     fd;
+    ssize_t count;
+
+    snprintf(path, sizeof(path), "%s/%s", dir, file);
+
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+
+    count = read(fd, buffer, size - 1);
+    close(fd);
+
+    if (count < 0) {
+        return -1;
+    }
+
+    buffer[count] = '\0';
+    return 0;
+}
+
+/* Returns value of "key value" line of a flat keyed file, 0 if the key is not found */
+static long cgroup_key_value(const char * buffer, const char * key)
+{
+    size_t      size = strlen(key);
+    const char *line = buffer;
+
+    while (line != NULL && *line != '\0') {
+        if (0 == strncmp(line, key, size) && line[size] == ' ') {
+            return strtol(line + size + 1, NULL, 10);
+        }
+
+        line = strchr(line, '\n');
+        line = line != NULL? line + 1: NULL;
+    }
+
+    return 0;
+}
+
+/* Reports changes of a counter, returns the new value */
+static long cgroup_report(cgroup_t * cgroup, cgroup_event_t event, long old_value, long value)
+{
+    if (value > old_value) {
+        cgroup->handler(cgroup->ctx, event, value - old_value);
+    }
+
+    return value;
+}
+
+static void cgroup_read_memory_events(cgroup_t * cgroup, int is_reported)
+{
+    char buffer[CGROUP_FILE_SIZE];
+    long oom_kill;
+    long high;
+    long max;
+
+    if (cgroup_read(cgroup->path, "memory.events", buffer, sizeof(buffer)) != 0) {
+        return;
+    }
+
+    oom_kill = cgroup_key_value(buffer, "oom_kill");
+    high     = cgroup_key_value(buffer, "high");
+    max      = cgroup_key_value(buffer, "max");
+
+    if (is_reported) {
+        cgroup_report(cgroup, CE_OOM_KILL, cgroup->oom_kill, oom_kill);
+        cgroup_report(cgroup, CE_MEMORY_MAX, cgroup->max, max);
+        cgroup_report(cgroup, CE_MEMORY_HIGH, cgroup->high, high);
+    }
+
+    cgroup->oom_kill = oom_kill;
+    cgroup->high     = high;
+    cgroup->max      = max;
+}
+
+static void cgroup_read_events(cgroup_t * cgroup, int is_reported)
+{
+    char buffer[CGROUP_FILE_SIZE];
+    int  is_populated;
+
+    if (cgroup_read(cgroup->path, "cgroup.events", buffer, sizeof(buffer)) != 0) {
+        return;
+    }
+
+    is_populated = cgroup_key_value(buffer, "populated") != 0;
+
+    if (is_reported && cgroup->is_populated && !is_populated) {
+        cgroup->handler(cgroup->ctx, CE_EMPTY, 1);
+    }
+
+    cgroup->is_populated = is_populated;
+}
+
+static void on_inotify(int fd, uint32_t events, void * ctx)
+{
+    char                        buffer[sizeof(struct inotify_event) * 16 + NAME_MAX + 1] __attribute__((aligned(__alignof__(struct inotify_event))));
+    const struct inotify_event *event;
+    ssize_t                     count;
+
+    (void)events;
+    (void)ctx;
+
+    count = read(fd, buffer, sizeof(buffer));
+
+    for (char *ptr = buffer; count > 0 && ptr < buffer + count; ptr += sizeof(*event) + event->len) {
+        event = (const struct inotify_event *)ptr;
+
+        for (size_t i = 0; i < g_cgroups_count; ++i) {
+            if (event->wd == g_cgroups[i]->memory_wd) {
+                cgroup_read_memory_events(g_cgroups[i], 1);
+            }
+            else if (event->wd == g_cgroups[i]->events_wd) {
+                cgroup_read_events(g_cgroups[i], 1);
+            }
+        }
+    }
+}
+
+static int cgroup_watch(cgroup_t * cgroup, const char * file)
+{
+    char path[MAX_PATH_SIZE + CGROUP_FILE_NAME_SIZE];
+    int  wd;
+
+    snprintf(path, sizeof(path), "%s/%s", cgroup->path, file);
+
+    wd = inotify_add_watch(g_inotify_fd, path, IN_MODIFY);
+    if (wd < 0) {
+        LOG_WARN("failed to watch %s: %d (%s)", path, errno, strerror(errno));
+    }
+
+    return wd;
+}
+
+static int cgroup_init(void)
+{
+    int error;
+
+    if (g_inotify_fd != -1) {
+        return 0;
+    }
+
+    g_inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (g_inotify_fd < 0) {
+        error = errno;
+        LOG_ERROR("failed to create inotify descriptor: %d (%s)", error, strerror(error));
+        return error;
+    }
+
+    error = loop_add_fd(g_inotify_fd, EPOLLIN, on_inotify, NULL);
+    if (error) {
+        close(g_inotify_fd);
+        g_inotify_fd = -1;
+    }
+
+    return error;
+}
+
+int cgroup_open(cgroup_t * cgroup, const char * root, const char * name, const char * const limits[3], cgroup_handler_t handler, void * ctx)
+{
+    char path[MAX_PATH_SIZE];
+    int  count;
+    int  error;
+
+    count = snprintf(path, sizeof(path), "%s/%s", root, name);
+    if (count < 0 || (size_t)count >= sizeof(path)) {
+        return ENAMETOOLONG;
+    }
+
+    if (cgroup->path[0] != '\0' && 0 != strcmp(cgroup->path, path)) {
+        cgroup_close(cgroup);
+    }
+
+    if ((mkdir(root, 0755) != 0 && errno != EEXIST) || (mkdir(path, 0755) != 0 && errno != EEXIST)) {
+        error = errno;
+        LOG_ERROR("failed to create cgroup %s: %d (%s)", path, error, strerror(error));
+        return error;
+    }
+
+    /* controllers may be unavailable, the cgroup is still useful to track the processes */
+    error = cgroup_write(root, "cgroup.subtree_control", CGROUP_CONTROLLERS);
+    if (error) {
+        LOG_WARN("failed to enable \"%s\" controllers in %s: %d (%s)", CGROUP_CONTROLLERS, root, error, strerror(error));
+    }
+
+    for (size_t i = 0; i < sizeof(limit_files) / sizeof(limit_files[0]); ++i) {
+        error = cgroup_write(path, limit_files[i], limits[i][0] != '\0'? limits[i]: "max");
+        if (error && limits[i][0] != '\0') {
+            LOG_ERROR("failed to set %s of cgroup %s to \"%s\": %d (%s)", limit_files[i], path, limits[i], error, strerror(error));
+        }
+    }
+
+    cgroup->handler = handler;
+    cgroup->ctx     = ctx;
+
+    if (cgroup->path[0] != '\0') {
+        return 0;
+    }
+
+    error = cgroup_init();
+    if (error) {
+        return error;
+    }
+
+    if (g_cgroups_count == MAX_CGROUPS) {
+        return ENOSPC;
+    }
+
+    strcpy(cgroup->path, path);
+    cgroup->memory_wd = cgroup_watch(cgroup, "memory.events");
+    cgroup->events_wd = cgroup_watch(cgroup, "cgroup.events");
+
+    /* only changes made after this point are reported */
+    cgroup_read_memory_events(cgroup, 0);
+    cgroup_read_events(cgroup, 0);
+
+    g_cgroups[g_cgroups_count++] = cgroup;
+
+    LOG_INFO("using cgroup %s", path);
+    return 0;
+}
+
+void cgroup_close(cgroup_t * cgroup)
+{
+    if (cgroup->path[0] == '\0') {
+        return;
+    }
+
+    for (size_t i = 0; i < g_cgroups_count; ++i) {
+        if (g_cgroups[i] == cgroup) {
+            g_cgroups[i] = g_cgroups[--g_cgroups_count];
+            break;
+        }
+    }
+
+    if (cgroup->memory_wd >= 0) {
+        inotify_rm_watch(g_inotify_fd, cgroup->memory_wd);
+    }
+
+    if (cgroup->events_wd >= 0) {
+        inotify_rm_watch(g_inotify_fd, cgroup->events_wd);
+    }
+
+    /* fails if processes are still there, they keep running in it */
+    rmdir(cgroup->path);
+    cgroup->path[0] = '\0';
+}
@@ -0,0 +1,76 @@
+/*
+################################################################################
+#
+#  Copyright 2020-2021 Inango Systems Ltd.
+#
+#  Licensed under the Apache License, Version 2.0 (the "License");
+#  you may not use this file except in compliance with the License.
+#  You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+#  Unless required by applicable law or agreed to in writing, software
+#  distributed under the License is distributed on an "AS IS" BASIS,
+#  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+#  See the License for the specific language governing permissions and
+#  limitations under the License.
+#
+################################################################################
+*/
+#ifndef CHANDLER_CGROUP_H
+#define CHANDLER_CGROUP_H
+
+#include "chandler_system.h"
+
+#define MAX_CGROUPS           MAX_SERVICES
+
+/* Changes of cgroup state reported to the owner */
+typedef enum cgroup_event_t {
+    CE_OOM_KILL,                             // processes have been killed by OOM killer (memory.events: oom_kill)
+    CE_MEMORY_HIGH,                          // processes have been throttled over memory.high (memory.events: high)
+    CE_MEMORY_MAX,                           // memory usage has hit memory.max (memory.events: max)
+    CE_EMPTY                                 // the last process has left the cgroup (cgroup.events: populated 0)
+} cgroup_event_t;
+
+/* Called from the event loop, count - number of events since the previous call */
+typedef void (* cgroup_handler_t)(void * ctx, cgroup_event_t event, long count);
+
+/*
+ * cgroup v2 subgroup of a daemon. memory.events and cgroup.events generate
+ * file modified events, so they are watched with inotify and read only
+ * when they change.
+ */
+typedef struct cgroup_t {
+    char              path[MAX_PATH_SIZE];   // directory of the cgroup (empty - cgroup is not open)
+    int               memory_wd;             // inotify watch of memory.events (-1 - none)
+    int               events_wd;             // inotify watch of cgroup.events (-1 - none)
+    long              oom_kill;              // the latest counters read from memory.events
+    long              high;
+    long              max;
+    int               is_populated;
+    cgroup_handler_t  handler;
+    void             *ctx;
+} cgroup_t;
+
+/**
+ * Creates the cgroup <root>/<name> if needed, enables memory and cpu
+ * controllers in root and starts watching the cgroup. Can be called again
+ * for an open cgroup to update its limits.
+ *
+ * \param cgroup       The cgroup
+ * \param root         cgroup v2 directory the cgroup is created in
+ * \param name         Name of the cgroup
+ * \param limits       memory.high, memory.max and cpu.max values (empty string - "max")
+ * \param handler      Handler of cgroup events
+ * \param ctx          Context passed to the handler
+ *
+ * \return             0 - on success, errno - on failure (failures to set limits are only logged)
+ */
+int  cgroup_open(cgroup_t * cgroup, const char * root, const char * name, const char * const limits[3], cgroup_handler_t handler, void * ctx);
+
+/**
+ * Stops watching the cgroup and removes it if it is empty.
+ */
+void cgroup_close(cgroup_t * cgroup);
+
+#endif  /* CHANDLER_CGROUP_H */
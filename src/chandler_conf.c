@@ -19,6 +19,7 @@
 */
 #define _GNU_SOURCE
 
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -30,6 +31,8 @@
 
 
 #define DEFAULT_OVS_RUNDIR  "/usr/local/var/run/openvswitch"
+#define DEFAULT_PROBE       "list-commands"
+#define SERVICE_KEY_PREFIX  "service."
 
 
 typedef enum conf_value_type_t {
@@ -46,6 +49,16 @@ typedef struct conf_value_t {
     size_t             size;
 } conf_value_t;
 
+/* Field of service_conf_t set by "service.<name>.<key>" */
+typedef struct service_key_t {
+    const char        *key;
+    conf_value_type_t  value_type;
+    size_t             offset;
+    size_t             size;
+} service_key_t;
+
+#define SERVICE_FIELD(FIELD__)  offsetof(service_conf_t, FIELD__), sizeof(((service_conf_t *)0)->FIELD__)
+
 
 static chandler_conf_t chandler_conf = {
     .ovs_run_dir            = DEFAULT_OVS_RUNDIR,
@@ -65,17 +78,78 @@ static chandler_conf_t chandler_conf = {
                               " --pidfile=" DEFAULT_OVS_RUNDIR "/ovsdb-server.pid"
                               " --detach",
     .ovs_cmd_disconnect     = "",
+    .ovs_cmd_slow           = "",
     .ovs_cmd_reboot         = "",
+    .ovs_cmd_remediate      = "",
+    .escalation             = "restart",
     .ovs_unixsock_db        = "",
+    .ctl_unixsock           = "",
+    .event_unixsock         = "",
+    .prom_unixsock          = "",
+    .state_file             = "",
+    .cgroup_root            = "",
+    .maintenance_window     = "",
     //.bridge_name            = "",
     //.controller_addr        = "",
     .check_interval         = CHECK_INTERVAL_MSEC,
+    .recheck_interval       = RECHECK_INTERVAL_MSEC,
+    .check_jitter           = CHECK_JITTER_PERCENT,
     .request_retries        = 1,
     .receive_timeout        = RECV_TIMEOUT_MSEC,
+    .receive_timeout_min    = RECV_TIMEOUT_MIN_MSEC,
+    .rtt_percentile         = RTT_PERCENTILE,
+    .rtt_factor             = RTT_FACTOR,
+    .deadline_misses        = DEADLINE_MISSES,
+    .slow_ewma              = SLOW_EWMA_MSEC,
+    .slow_percentile        = SLOW_PERCENTILE_MSEC,
+    .echo_interval          = ECHO_INTERVAL_MSEC,
+    .hook_timeout           = HOOK_TIMEOUT_MSEC,
+    .startup_grace          = STARTUP_GRACE_MSEC,
+    .kill_timeout           = KILL_TIMEOUT_MSEC,
+    .supervise              = SUPERVISE_CHILDREN,
+    .sample_interval        = SAMPLE_INTERVAL_MSEC,
+    .busy_percent           = BUSY_PERCENT,
+    .busy_window            = BUSY_WINDOW_MSEC,
+    .stuck_timeout          = STUCK_TIMEOUT_MSEC,
     .failures_before_reboot = 0,
-    .restarts_before_reboot = 0
+    .restarts_before_reboot = 0,
+    .failures_window        = REBOOT_WINDOW_MSEC,
+    .restarts_window        = REBOOT_WINDOW_MSEC,
+    .restart_backoff_min    = BACKOFF_MIN_MSEC,
+    .restart_backoff_max    = BACKOFF_MAX_MSEC,
+    .max_reboots            = MAX_REBOOTS,
+    .reboots_window         = REBOOT_WINDOW_MSEC
 };
 
+static const service_key_t service_keys[] = {
+    {"ctl",             VT_STRING,  SERVICE_FIELD(ctl)},
+    {"pidfile",         VT_STRING,  SERVICE_FIELD(pidfile)},
+    {"command",         VT_STRING,  SERVICE_FIELD(command)},
+    {"probe",           VT_STRING,  SERVICE_FIELD(probe)},
+    {"depends_on",      VT_STRING,  SERVICE_FIELD(depends_on)},
+    {"receive_timeout", VT_INTEGER, SERVICE_FIELD(receive_timeout)},
+    {"startup_grace",   VT_INTEGER, SERVICE_FIELD(startup_grace)},
+    {"cpu_affinity",    VT_STRING,  SERVICE_FIELD(cpu_affinity)},
+    {"sched",           VT_STRING,  SERVICE_FIELD(sched)},
+    {"ioprio",          VT_STRING,  SERVICE_FIELD(ioprio)},
+    {"oom_score_adj",   VT_STRING,  SERVICE_FIELD(oom_score_adj)},
+    {"rlimit_nofile",   VT_STRING,  SERVICE_FIELD(rlimit_nofile)},
+    {"rlimit_core",     VT_STRING,  SERVICE_FIELD(rlimit_core)},
+    {"rlimit_memlock",  VT_STRING,  SERVICE_FIELD(rlimit_memlock)},
+    {"memory_high",     VT_STRING,  SERVICE_FIELD(memory_high)},
+    {"memory_max",      VT_STRING,  SERVICE_FIELD(memory_max)},
+    {"cpu_max",         VT_STRING,  SERVICE_FIELD(cpu_max)},
+    {"busy_threads",    VT_STRING,  SERVICE_FIELD(busy_threads)},
+    {"busy_action",     VT_STRING,  SERVICE_FIELD(busy_action)},
+    {"stuck_threads",   VT_STRING,  SERVICE_FIELD(stuck_threads)},
+    {"pss_growth",      VT_INTEGER, SERVICE_FIELD(pss_growth)},
+    {NULL,              VT_NONE,    0, 0}
+};
+
+/* Copy of the built-in values taken before the configuration is loaded for the first time */
+static chandler_conf_t default_conf;
+static int             is_default_conf_saved = 0;
+
 static conf_value_t conf_values[] = {
     {"ovs_run_dir",            "CHANDLER_OVS_RUNDIR",         VT_STRING,  chandler_conf.ovs_run_dir,             sizeof(chandler_conf.ovs_run_dir)},
     {"ovs_name_switch",        "CHANDLER_NAME_SW",            VT_STRING,  chandler_conf.ovs_name_switch,         sizeof(chandler_conf.ovs_name_switch)},
@@ -87,26 +161,68 @@ static conf_value_t conf_values[] = {
     {"ovs_cmd_switch",         "CHANDLER_CMD_RUN_SW",         VT_STRING,  chandler_conf.ovs_cmd_switch,          sizeof(chandler_conf.ovs_cmd_switch)},
     {"ovs_cmd_db",             "CHANDLER_CMD_RUN_DB",         VT_STRING,  chandler_conf.ovs_cmd_db,              sizeof(chandler_conf.ovs_cmd_db)},
     {"ovs_cmd_disconnect",     "CHANDLER_CMD_DISCON",         VT_STRING,  chandler_conf.ovs_cmd_disconnect,      sizeof(chandler_conf.ovs_cmd_disconnect)},
+    {"ovs_cmd_slow",           "CHANDLER_CMD_SLOW",           VT_STRING,  chandler_conf.ovs_cmd_slow,            sizeof(chandler_conf.ovs_cmd_slow)},
     {"ovs_cmd_reboot",         "CHANDLER_CMD_REBOOT",         VT_STRING,  chandler_conf.ovs_cmd_reboot,          sizeof(chandler_conf.ovs_cmd_reboot)},
+    {"ovs_cmd_remediate",      "CHANDLER_CMD_REMEDIATE",      VT_STRING,  chandler_conf.ovs_cmd_remediate,       sizeof(chandler_conf.ovs_cmd_remediate)},
+    {"escalation",             "CHANDLER_ESCALATION",         VT_STRING,  chandler_conf.escalation,              sizeof(chandler_conf.escalation)},
     {"ovs_unixsock_db",        "CHANDLER_UNIXSOCK_DB",        VT_STRING,  chandler_conf.ovs_unixsock_db,         sizeof(chandler_conf.ovs_unixsock_db)},
+    {"ctl_unixsock",           "CHANDLER_CTL_SOCK",           VT_STRING,  chandler_conf.ctl_unixsock,            sizeof(chandler_conf.ctl_unixsock)},
+    {"event_unixsock",         "CHANDLER_EVENT_SOCK",         VT_STRING,  chandler_conf.event_unixsock,          sizeof(chandler_conf.event_unixsock)},
+    {"prom_unixsock",          "CHANDLER_PROM_SOCK",          VT_STRING,  chandler_conf.prom_unixsock,           sizeof(chandler_conf.prom_unixsock)},
+    {"state_file",             "CHANDLER_STATE_FILE",         VT_STRING,  chandler_conf.state_file,              sizeof(chandler_conf.state_file)},
+    {"cgroup_root",            "CHANDLER_CGROUP_ROOT",        VT_STRING,  chandler_conf.cgroup_root,             sizeof(chandler_conf.cgroup_root)},
+    {"maintenance_window",     "CHANDLER_MAINTENANCE_WINDOW", VT_STRING,  chandler_conf.maintenance_window,      sizeof(chandler_conf.maintenance_window)},
     //{"bridge_name",            "CHANDLER_BRIDGE",             VT_STRING,  chandler_conf.bridge_name,             sizeof(chandler_conf.bridge_name)},
     //{"addrs",                  NULL,                     VT_STRING,  chandler_conf.addrs,                   sizeof(chandler_conf.addrs)},
     //{"addrs_count",            NULL,                     VT_INTEGER, &chandler_conf.addrs_count,            0},
     //{"controller_addr",        "CHANDLER_OVS_CONTROLLER",     VT_STRING,  chandler_conf.controller_addr,         sizeof(chandler_conf.controller_addr)},
     {"check_interval",         "CHANDLER_CHECK_INTERVAL",     VT_INTEGER, &chandler_conf.check_interval,         0},
+    {"recheck_interval",       "CHANDLER_RECHECK_INTERVAL",   VT_INTEGER, &chandler_conf.recheck_interval,       0},
+    {"check_jitter",           "CHANDLER_CHECK_JITTER",       VT_INTEGER, &chandler_conf.check_jitter,           0},
     {"request_retries",        "CHANDLER_REQ_RETRIES",        VT_INTEGER, &chandler_conf.request_retries,        0},
     {"receive_timeout",        "CHANDLER_RECV_TIMEOUT",       VT_INTEGER, &chandler_conf.receive_timeout,        0},
+    {"receive_timeout_min",    "CHANDLER_RECV_TIMEOUT_MIN",   VT_INTEGER, &chandler_conf.receive_timeout_min,    0},
+    {"rtt_percentile",         "CHANDLER_RTT_PERCENTILE",     VT_INTEGER, &chandler_conf.rtt_percentile,         0},
+    {"rtt_factor",             "CHANDLER_RTT_FACTOR",         VT_INTEGER, &chandler_conf.rtt_factor,             0},
+    {"deadline_misses",        "CHANDLER_DEADLINE_MISSES",    VT_INTEGER, &chandler_conf.deadline_misses,        0},
+    {"slow_ewma",              "CHANDLER_SLOW_EWMA",          VT_INTEGER, &chandler_conf.slow_ewma,              0},
+    {"slow_percentile",        "CHANDLER_SLOW_PERCENTILE",    VT_INTEGER, &chandler_conf.slow_percentile,        0},
+    {"echo_interval",          "CHANDLER_ECHO_INTERVAL",      VT_INTEGER, &chandler_conf.echo_interval,          0},
+    {"hook_timeout",           "CHANDLER_HOOK_TIMEOUT",       VT_INTEGER, &chandler_conf.hook_timeout,           0},
+    {"startup_grace",          "CHANDLER_STARTUP_GRACE",      VT_INTEGER, &chandler_conf.startup_grace,          0},
+    {"kill_timeout",           "CHANDLER_KILL_TIMEOUT",       VT_INTEGER, &chandler_conf.kill_timeout,           0},
+    {"supervise",              "CHANDLER_SUPERVISE",          VT_INTEGER, &chandler_conf.supervise,              0},
+    {"sample_interval",        "CHANDLER_SAMPLE_INTERVAL",    VT_INTEGER, &chandler_conf.sample_interval,        0},
+    {"busy_percent",           "CHANDLER_BUSY_PERCENT",       VT_INTEGER, &chandler_conf.busy_percent,           0},
+    {"busy_window",            "CHANDLER_BUSY_WINDOW",        VT_INTEGER, &chandler_conf.busy_window,            0},
+    {"stuck_timeout",          "CHANDLER_STUCK_TIMEOUT",      VT_INTEGER, &chandler_conf.stuck_timeout,          0},
     {"failures_before_reboot", "CHANDLER_FAILURES_TO_REBOOT", VT_INTEGER, &chandler_conf.failures_before_reboot, 0},
     {"restarts_before_reboot", "CHANDLER_RESTARTS_TO_REBOOT", VT_INTEGER, &chandler_conf.restarts_before_reboot, 0},
+    {"failures_window",        "CHANDLER_FAILURES_WINDOW",    VT_INTEGER, &chandler_conf.failures_window,        0},
+    {"restarts_window",        "CHANDLER_RESTARTS_WINDOW",    VT_INTEGER, &chandler_conf.restarts_window,        0},
+    {"restart_backoff_min",    "CHANDLER_BACKOFF_MIN",        VT_INTEGER, &chandler_conf.restart_backoff_min,    0},
+    {"restart_backoff_max",    "CHANDLER_BACKOFF_MAX",        VT_INTEGER, &chandler_conf.restart_backoff_max,    0},
+    {"max_reboots",            "CHANDLER_MAX_REBOOTS",        VT_INTEGER, &chandler_conf.max_reboots,            0},
+    {"reboots_window",         "CHANDLER_REBOOTS_WINDOW",     VT_INTEGER, &chandler_conf.reboots_window,         0},
     {NULL,                     NULL,                     VT_NONE,    NULL,                             0}
 };
 
 
+static void save_default_conf(void)
+{
+    if (!is_default_conf_saved) {
+        default_conf = chandler_conf;
+        is_default_conf_saved = 1;
+    }
+}
+
 void load_conf_env(void)
 {
     long  long_value;
     char *end;
 
+    save_default_conf();
+
     for (conf_value_t *conf_value = conf_values; conf_value->name != NULL; ++conf_value)
     {
         if (conf_value->env_name == NULL)
@@ -149,6 +265,14 @@ void load_conf_env(void)
     }
 }
 
+/* Blank lines and lines starting with '#' carry no key */
+static int is_comment_line(const char * line_buf)
+{
+    const char *start = line_buf + strspn(line_buf, " \t");
+
+    return *start == '#' || *start == '\n' || *start == '\0';
+}
+
 static int get_key_value(char * line_buf, size_t line_size, char ** key_ptr, size_t * key_size, char ** value_ptr, size_t * value_size)
 {
     char   *delimiter;
@@ -201,6 +325,132 @@ static int get_key_value(char * line_buf, size_t line_size, char ** key_ptr, siz
     return 0;
 }
 
+static service_conf_t * find_service(service_conf_t * services, long count, const char * name, size_t name_size)
+{
+    for (long i = 0; i < count; ++i) {
+        if (strlen(services[i].name) == name_size && 0 == strncmp(services[i].name, name, name_size)) {
+            return &services[i];
+        }
+    }
+
+    return NULL;
+}
+
+/* Handles "<name>.<key>" part of service.<name>.<key> */
+static int update_service_key_value(const char *key, const char *value, size_t value_size)
+{
+    const char     *dot = strrchr(key, '.');
+    service_conf_t *service;
+    char           *target;
+    long            long_value;
+    char           *end;
+
+    if (dot == NULL || dot == key || (size_t)(dot - key) >= sizeof(service->name)) {
+        LOG_ERROR("Invalid service key \"%s%s\"", SERVICE_KEY_PREFIX, key);
+        return -1;
+    }
+
+    service = find_service(chandler_conf.services, chandler_conf.services_count, key, dot - key);
+    if (service == NULL) {
+        if (chandler_conf.services_count == MAX_SERVICES) {
+            LOG_ERROR("Too many services (> %d) in configuration", MAX_SERVICES);
+            return -1;
+        }
+
+        service = &chandler_conf.services[chandler_conf.services_count++];
+        memset(service, 0, sizeof(*service));
+        memcpy(service->name, key, dot - key);
+        strcpy(service->probe, DEFAULT_PROBE);
+    }
+
+    for (const service_key_t *service_key = service_keys; service_key->key != NULL; ++service_key) {
+        if (0 != strcmp(service_key->key, dot + 1)) {
+            continue;
+        }
+
+        target = (char *)service + service_key->offset;
+
+        switch (service_key->value_type) {
+        case VT_STRING:
+            if (value_size > service_key->size) {
+                LOG_ERROR("Failed to read string value for key \"%s%s\" from configuration", SERVICE_KEY_PREFIX, key);
+                return -1;
+            }
+            strncpy(target, value, value_size);
+            break;
+
+        default:
+            long_value = strtol(value, &end, 10);
+            if (*end != '\0') {
+                LOG_ERROR("Failed to read integer value for key \"%s%s\" from configuration", SERVICE_KEY_PREFIX, key);
+                return -1;
+            }
+            *(long *)target = long_value;
+        }
+
+        return 0;
+    }
+
+    LOG_ERROR("Unknown service key \"%s%s\"", SERVICE_KEY_PREFIX, key);
+    return -1;
+}
+
+/* Fields not configured with service.<name>.<key> are taken from ovs_* keys */
+static void fill_legacy_service(service_conf_t * service, const char * ctl, const char * pidfile, const char * command, const char * depends_on)
+{
+    if (service->ctl[0] == '\0') {
+        strcpy(service->ctl, ctl);
+    }
+
+    if (service->pidfile[0] == '\0') {
+        strcpy(service->pidfile, pidfile);
+    }
+
+    if (service->command[0] == '\0') {
+        strcpy(service->command, command);
+    }
+
+    if (service->depends_on[0] == '\0') {
+        strcpy(service->depends_on, depends_on);
+    }
+}
+
+void add_legacy_services(void)
+{
+    service_conf_t  legacy[2];
+    service_conf_t *service;
+    long            count = 0;
+
+    memset(legacy, 0, sizeof(legacy));
+
+    service = find_service(chandler_conf.services, chandler_conf.services_count, "ovsdb-server", strlen("ovsdb-server"));
+    if (service == NULL) {
+        service = &legacy[count++];
+        strcpy(service->name, "ovsdb-server");
+        strcpy(service->probe, DEFAULT_PROBE);
+    }
+
+    fill_legacy_service(service, chandler_conf.ovs_name_db, chandler_conf.ovs_pidfile_db, chandler_conf.ovs_cmd_db, "");
+
+    service = find_service(chandler_conf.services, chandler_conf.services_count, "ovs-vswitchd", strlen("ovs-vswitchd"));
+    if (service == NULL) {
+        service = &legacy[count++];
+        strcpy(service->name, "ovs-vswitchd");
+        strcpy(service->probe, DEFAULT_PROBE);
+    }
+
+    fill_legacy_service(service, chandler_conf.ovs_name_switch, chandler_conf.ovs_pidfile_switch, chandler_conf.ovs_cmd_switch, "ovsdb-server");
+
+    if (chandler_conf.services_count + count > MAX_SERVICES) {
+        LOG_ERROR("Too many services (> %d) in configuration - ignoring the last ones", MAX_SERVICES);
+        chandler_conf.services_count = MAX_SERVICES - count;
+    }
+
+    memmove(&chandler_conf.services[count], &chandler_conf.services[0], chandler_conf.services_count * sizeof(service_conf_t));
+    memcpy(&chandler_conf.services[0], legacy, count * sizeof(service_conf_t));
+    chandler_conf.services_count += count;
+}
+
 static int update_conf_key_value(const char *key, const char *value, size_t value_size)
 {
     long  long_value;
@@ -235,6 +485,10 @@ static int update_conf_key_value(const char *key, const char *value, size_t valu
         }
     }
 
+    if (0 == strncmp(key, SERVICE_KEY_PREFIX, strlen(SERVICE_KEY_PREFIX))) {
+        return update_service_key_value(key + strlen(SERVICE_KEY_PREFIX), value, value_size);
+    }
+
     /* Unknown key - for now not an error */
     return 0;
 }
@@ -257,6 +511,8 @@ int load_conf_file(const char * conf_file_name)
     char    *value;
     size_t   value_size;
 
+    save_default_conf();
+
     fp = fopen(conf_file_name, "r");
     if (!fp)
     {
@@ -264,20 +520,24 @@ int load_conf_file(const char * conf_file_name)
         return errno;
     }
 
+    /* errno is checked after the loop to tell EOF from read failure */
+    errno = 0;
     line_size = getline(&line_buf, &line_buf_size, fp);
 
     while (line_size >= 0)
     {
         ++line_count;
 
-        error = get_key_value(line_buf, line_size, &key, &key_size, &value, &value_size);
-        if (error != 0) {
-            break;
-        }
+        if (!is_comment_line(line_buf)) {
+            error = get_key_value(line_buf, line_size, &key, &key_size, &value, &value_size);
+            if (error != 0) {
+                break;
+            }
 
-        error = update_conf_key_value(key, value, value_size);
-        if (error != 0) {
-            break;
+            error = update_conf_key_value(key, value, value_size);
+            if (error != 0) {
+                break;
+            }
         }
 
         line_size = getline(&line_buf, &line_buf_size, fp);
@@ -296,3 +556,67 @@ int load_conf_file(const char * conf_file_name)
 
     return error;
 }
+
+static int is_conf_value_changed(const conf_value_t * conf_value, const chandler_conf_t * old_conf)
+{
+    const void *old_target = (const char *)old_conf + ((const char *)conf_value->target - (const char *)&chandler_conf);
+
+    switch (conf_value->value_type)
+    {
+    case VT_STRING:
+        return 0 != strcmp(conf_value->target, old_target);
+    case VT_INTEGER:
+        return *(const long *)conf_value->target != *(const long *)old_target;
+    default:
+        return 0;
+    }
+}
+
+int reload_conf(const char * conf_file_name, conf_changes_t * changes)
+{
+    static chandler_conf_t old_conf;
+
+    int error = 0;
+    int index = 0;
+
+    save_default_conf();
+
+    old_conf      = chandler_conf;
+    chandler_conf = default_conf;
+
+    if (conf_file_name && conf_file_name[0] != '\0') {
+        error = load_conf_file(conf_file_name);
+        if (error != 0) {
+            LOG_ERROR("failed to reload configuration from file \"%s\" - keeping the current one", conf_file_name);
+            chandler_conf = old_conf;
+            return error;
+        }
+    }
+
+    load_conf_env();
+    add_legacy_services();
+
+    changes->mask = 0;
+
+    for (conf_value_t *conf_value = conf_values; conf_value->name != NULL; ++conf_value, ++index) {
+        if (is_conf_value_changed(conf_value, &old_conf)) {
+            LOG_INFO("configuration value \"%s\" has changed", conf_value->name);
+            changes->mask |= (uint64_t)1 << index;
+        }
+    }
+
+    return 0;
+}
+
+int is_conf_changed(const conf_changes_t * changes, const void * value)
+{
+    int index = 0;
+
+    for (conf_value_t *conf_value = conf_values; conf_value->name != NULL; ++conf_value, ++index) {
+        if (conf_value->target == value) {
+            return (changes->mask & ((uint64_t)1 << index)) != 0;
+        }
+    }
+
+    return 0;
+}
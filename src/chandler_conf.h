@@ -22,6 +22,37 @@
 
 #include "chandler_system.h"
 
+#include <stdint.h>
+
+/* Value of service probe which checks only that the process exists */
+#define PROBE_PROCESS  "process"
+
+/* Service supervised by chandler, configured with "service.<name>.<field> = value" keys */
+typedef struct service_conf_t {
+    char name[MAX_APP_NAME_SIZE];                // name used in events, metrics and dependencies
+    char ctl[MAX_PATH_SIZE];                     // control socket: absolute path or name of <name>.<pid>.ctl in ovs_run_dir (empty - same as name)
+    char pidfile[MAX_PATH_SIZE];                 // absolute path or name in ovs_run_dir (empty - <ctl>.pid)
+    char command[MAX_COMMAND_SIZE];              // command to launch the service
+    char probe[MAX_METHOD_SIZE];                 // unixctl method used as a probe, or "process" to check only that the process exists
+    char depends_on[MAX_COMMAND_SIZE];           // names of services which have to be started first, separated by commas
+    long receive_timeout;                        // max probe deadline in msec (0 - receive_timeout)
+    long startup_grace;                          // time in msec given to the service to become ready after spawn (0 - startup_grace)
+    char cpu_affinity[MAX_POLICY_SIZE];          // CPUs the service is bound to, like "2-3,6" (empty - inherited from chandler)
+    char sched[MAX_POLICY_SIZE];                 // POLICY[:PRIORITY]: other, batch or idle with nice value, fifo or rr with static priority
+    char ioprio[MAX_POLICY_SIZE];                // CLASS[:LEVEL]: rt, be or idle, level is 0-7
+    char oom_score_adj[MAX_POLICY_SIZE];         // -1000..1000 (empty - inherited from chandler)
+    char rlimit_nofile[MAX_POLICY_SIZE];         // soft and hard limits: a number or "unlimited" (empty - inherited from chandler)
+    char rlimit_core[MAX_POLICY_SIZE];
+    char rlimit_memlock[MAX_POLICY_SIZE];
+    char memory_high[MAX_POLICY_SIZE];           // memory.high of the service cgroup (empty - max)
+    char memory_max[MAX_POLICY_SIZE];            // memory.max of the service cgroup (empty - max)
+    char cpu_max[MAX_POLICY_SIZE];               // cpu.max of the service cgroup: "QUOTA PERIOD" in usec (empty - max)
+    char busy_threads[MAX_POLICY_SIZE];          // name prefixes of threads checked for busy loops, like "handler,revalidator,pmd,urcu" (empty - disabled)
+    char stuck_threads[MAX_POLICY_SIZE];         // name prefixes of threads checked for being stuck in D state or on a lock (empty - disabled)
+    char busy_action[MAX_POLICY_SIZE];           // action taken on a busy loop: restart, restart_all, command or reboot (empty - only reported)
+    long pss_growth;                             // growth of PSS (RSS if not available) in kB since startup which plans a restart (0 - disabled)
+} service_conf_t;
+
 typedef struct chandler_conf_t {
     char ovs_run_dir[MAX_PATH_SIZE];
     char ovs_name_switch[MAX_APP_NAME_SIZE];
@@ -33,26 +64,84 @@ typedef struct chandler_conf_t {
     char ovs_cmd_switch[MAX_COMMAND_SIZE];
     char ovs_cmd_db[MAX_COMMAND_SIZE];
     char ovs_cmd_disconnect[MAX_COMMAND_SIZE];
+    char ovs_cmd_slow[MAX_COMMAND_SIZE];         // command to run when a daemon becomes slow (empty - none)
     char ovs_cmd_reboot[MAX_COMMAND_SIZE];
+    char ovs_cmd_remediate[MAX_COMMAND_SIZE];    // command run by "command" step of the escalation ladder (empty - none)
+    char escalation[MAX_ESCALATION_SIZE];        // ladder of recovery actions, see escalation_parse()
     char ovs_unixsock_db[MAX_PATH_SIZE];
+    char ctl_unixsock[MAX_PATH_SIZE];            // unix socket to accept JSON-RPC control commands (empty - disabled)
+    char event_unixsock[MAX_PATH_SIZE];          // unix socket to publish health events as NDJSON (empty - disabled)
+    char prom_unixsock[MAX_PATH_SIZE];           // unix socket to export metrics in Prometheus text format (empty - disabled)
+    char state_file[MAX_PATH_SIZE];              // file keeping statistics across restarts and reboots, should not be on tmpfs (empty - disabled)
+    char cgroup_root[MAX_PATH_SIZE];             // cgroup v2 directory, every service is placed into its <name> subgroup (empty - disabled)
+    char maintenance_window[MAX_WINDOW_SIZE];    // "HH:MM-HH:MM" local time planned restarts are done in (empty - any time)
     //char bridge_name[MAX_BR_NAME_SIZE];
     //char addrs[MAX_ADDR_COUNT][MAX_ADDR_SIZE];
     //char addrs[MAX_ADDR_SIZE * MAX_ADDR_COUNT];
     //long addrs_count;
     //char controller_addr[MAX_ADDR_SIZE];
-    long check_interval;                         // services check interval in msec
+    long check_interval;                         // services check interval in msec (maximal, reached while daemons are healthy)
+    long recheck_interval;                       // check interval in msec at startup and after any anomaly, also delay between retries
+    long check_jitter;                           // random deviation of check intervals in percent
     long request_retries;                        // number of retries to query daemons via JRPC before blaming them as not alive
-    long receive_timeout;                        // timeout in msec for response receive operations
-    long failures_before_reboot;                 // number of failures before decision to reboot the system
-    long restarts_before_reboot;                 // number of daemons relaunches (after their death) before decision to reboot the system
+    long receive_timeout;                        // timeout in msec for response receive operations (upper bound of adaptive probe deadline)
+    long receive_timeout_min;                    // lower bound in msec of adaptive probe deadline
+    long rtt_percentile;                         // percentile of recent probe RTTs the probe deadline is derived from
+    long rtt_factor;                             // probe deadline = RTT percentile * rtt_factor
+    long deadline_misses;                        // number of consecutive missed probe deadlines to blame a daemon as not responding
+    long slow_ewma;                              // daemon is reported as slow when EWMA of its RTTs exceeds this value in msec (0 - disabled)
+    long slow_percentile;                        // daemon is reported as slow when rtt_percentile of its RTTs exceeds this value in msec (0 - disabled)
+    long echo_interval;                          // interval in msec of echo requests to ovsdb monitor connection (0 - disabled)
+    long hook_timeout;                           // timeout in msec after which hook commands are killed
+    long startup_grace;                          // time in msec given to a spawned daemon to create pidfile, ctl socket and answer a probe
+    long supervise;                              // 1 - daemons are run in the foreground as children of chandler, their output is logged
+    long kill_timeout;                           // time in msec given to a daemon to exit after SIGTERM and then after SIGKILL (0 - no SIGTERM)
+    long sample_interval;                        // interval in msec of daemons resource usage sampling (0 - disabled)
+    long busy_percent;                           // CPU usage of a thread in percent which is considered as busy
+    long busy_window;                            // time in msec a thread has to stay busy to be reported as saturated
+    long stuck_timeout;                          // time in msec without CPU progress after which a sleeping thread is stuck
+    long failures_before_reboot;                 // number of failures within failures_window before decision to reboot the system
+    long restarts_before_reboot;                 // number of daemons relaunches (after their death) within restarts_window before decision to reboot the system
+    long failures_window;                        // period in msec failures are counted over (0 - since start)
+    long restarts_window;                        // period in msec restarts are counted over (0 - since start)
+    long restart_backoff_min;                    // delay in msec before the second of quick relaunches of a daemon (0 - no backoff)
+    long restart_backoff_max;                    // max delay in msec before relaunch, the delay doubles while a daemon keeps dying
+    long max_reboots;                            // max number of reboots within reboots_window, further reboots are suppressed (0 - unlimited)
+    long reboots_window;                         // period in msec reboots are counted over to detect a reboot loop
+    service_conf_t services[MAX_SERVICES];       // ovsdb-server and ovs-vswitchd are added from ovs_* keys unless configured explicitly
+    long services_count;
 } chandler_conf_t;
 
-/* Loads configuration from file in format "key = value\n" */
+/* Set of configuration values changed by reload_conf() (one bit per known key, up to 64 keys) */
+typedef struct conf_changes_t {
+    uint64_t mask;
+} conf_changes_t;
+
+/* Loads configuration from file in format "key = value\n", blank lines and lines starting with # are skipped */
 int  load_conf_file(const char * conf_file_name);
 
 /* Loads configuration from environment variables */
 void load_conf_env(void);
 
+/*
+ * Adds ovsdb-server and ovs-vswitchd services described by ovs_* keys in
+ * front of the service table. If services with these names are defined
+ * with service.<name>.* keys, only their missing ctl, pidfile, command and
+ * depends_on are taken from ovs_* keys. Called after the configuration is
+ * loaded.
+ */
+void add_legacy_services(void);
+
+/*
+ * Reloads configuration from file (if not empty) and environment starting
+ * from built-in values and reports which values have changed. The current
+ * configuration is kept if the file can't be loaded.
+ */
+int  reload_conf(const char * conf_file_name, conf_changes_t * changes);
+
+/* Checks that value referenced by pointer to a field of get_conf() struct has been changed */
+int  is_conf_changed(const conf_changes_t * changes, const void * value);
+
 /* Returns pointer to configuration struct */
 const chandler_conf_t * get_conf(void);
 
@@ -0,0 +1,417 @@
+/*
+################################################################################
+#
+#  Copyright 2020-2021 Inango Systems Ltd.
+#
+#  Licensed under the Apache License, Version 2.0 (the "License");
+#  you may not use this file except in compliance with the License.
+#  You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+#  Unless required by applicable law or agreed to in writing, software
+#  distributed under the License is distributed on an "AS IS" BASIS,
+#  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+#  See the License for the specific language governing permissions and
+#  limitations under the License.
+#
+################################################################################
+*/
+#define _GNU_SOURCE
+
+#include "chandler_ctl.h"
+
+#include "chandler_jrpc.h"
+#include "chandler_log.h"
+#include "chandler_loop.h"
+#include "chandler_metrics.h"
+#include "chandler_ovs.h"
+#include "chandler_stat.h"
+#include "chandler_system.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+
+#define CTL_RESULT_SIZE       4096
+#define CTL_ARG_SIZE          64
+
+
+typedef struct ctl_client_t {
+    int     fd;
+    size_t  size;                              // number of bytes in request buffer
+    size_t  response_size;                     // number of bytes in response buffer
+    size_t  sent;                              // number of bytes of response already sent
+    char    request[CTL_REQUEST_SIZE];
+    char    response[CTL_RESPONSE_SIZE];
+} ctl_client_t;
+
+typedef struct ctl_server_t {
+    int                    fd;
+    const ctl_handlers_t  *handlers;
+    ctl_client_t           clients[MAX_CTL_CLIENTS];
+    int                    clients_count;
+} ctl_server_t;
+
+/* Command handler writes text of result or error to the buffer and returns 0 on success */
+typedef int (* ctl_command_handler_t)(const char * arg, char * buffer, size_t size);
+
+typedef struct ctl_command_t {
+    const char            *name;
+    const char            *usage;
+    ctl_command_handler_t  handler;
+} ctl_command_t;
+
+
+static ctl_server_t g_ctl = {.fd = -1};
+
+
+static int cmd_list_commands(const char * arg, char * buffer, size_t size);
+
+static int cmd_status(const char * arg, char * buffer, size_t size)
+{
+    int count;
+
+    (void)arg;
+
+    count = ovs_format_status(buffer, size);
+    if (count < 0 || (size_t)count >= size) {
+        return 0;
+    }
+
+    snprintf(buffer + count, size - count, "restarts: %ld, kills: %ld, failures: %ld, reboots: %ld, boots: %ld\n",
+        chandler_stat()->restarts_count, chandler_stat()->kills_count, chandler_stat()->failures_count,
+        chandler_stat()->reboots_count, chandler_stat()->boots_count);
+    return 0;
+}
+
+static int cmd_check_now(const char * arg, char * buffer, size_t size)
+{
+    (void)arg;
+
+    g_ctl.handlers->on_check_now();
+    snprintf(buffer, size, "check is scheduled\n");
+    return 0;
+}
+
+static int cmd_log_set(const char * arg, char * buffer, size_t size)
+{
+    static const char * const names[] = {"off", "err", "wrn", "inf", "dbg"};
+
+    long  level = -1;
+    char *end;
+
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); ++i) {
+        if (0 == strcmp(arg, names[i])) {
+            level = i;
+        }
+    }
+
+    if (level < 0) {
+        level = strtol(arg, &end, 0);
+        if (arg[0] == '\0' || *end != '\0' || level < CHANDLER_LOG_LEVEL_NIL_ID || level > CHANDLER_LOG_LEVEL_DBG_ID) {
+            snprintf(buffer, size, "invalid log level \"%s\" (expected 0-4 or off, err, wrn, inf, dbg)", arg);
+            return -1;
+        }
+    }
+
+    chandler_log_set_level(level);
+    LOG_INFO("log level is set to %ld", level);
+    snprintf(buffer, size, "log level is set to %ld\n", level);
+    return 0;
+}
+
+static int cmd_stats_reset(const char * arg, char * buffer, size_t size)
+{
+    (void)arg;
+
+    metrics_reset();
+    LOG_INFO("statistics have been reset");
+    snprintf(buffer, size, "statistics have been reset\n");
+    return 0;
+}
+
+static int cmd_reload(const char * arg, char * buffer, size_t size)
+{
+    (void)arg;
+
+    if (g_ctl.handlers->on_reload() != 0) {
+        snprintf(buffer, size, "failed to reload configuration");
+        return -1;
+    }
+
+    snprintf(buffer, size, "configuration has been reloaded\n");
+    return 0;
+}
+
+static const ctl_command_t g_commands[] = {
+    {"list-commands", "",      cmd_list_commands},
+    {"status",        "",      cmd_status},
+    {"check-now",     "",      cmd_check_now},
+    {"log/set",       "LEVEL", cmd_log_set},
+    {"stats/reset",   "",      cmd_stats_reset},
+    {"reload",        "",      cmd_reload},
+    {NULL,            NULL,    NULL}
+};
+
+static int cmd_list_commands(const char * arg, char * buffer, size_t size)
+{
+    int count;
+    int total;
+
+    (void)arg;
+
+    total = snprintf(buffer, size, "The available commands are:\n");
+
+    for (const ctl_command_t *command = g_commands; command->name != NULL && total >= 0 && (size_t)total < size; ++command) {
+        count = snprintf(buffer + total, size - total, "  %-20s %s\n", command->name, command->usage);
+        total = (count < 0)? count: total + count;
+    }
+
+    return 0;
+}
+
+/* Copies a value of the first element of params array */
+static void get_first_param(const ovsdb_message_parser_t * parser, const char * str, char * arg, size_t size)
+{
+    const jsmntok_t *t;
+    size_t           length;
+
+    arg[0] = '\0';
+
+    if (parser->params < 0 || parser->t[parser->params].type != JSMN_ARRAY || parser->t[parser->params].size == 0) {
+        return;
+    }
+
+    t = &parser->t[parser->params + 1];
+    if (t->type != JSMN_STRING && t->type != JSMN_PRIMITIVE) {
+        return;
+    }
+
+    length = t->end - t->start;
+    if (length >= size) {
+        length = size - 1;
+    }
+
+    memcpy(arg, str + t->start, length);
+    arg[length] = '\0';
+}
+
+static void client_respond(ctl_client_t * client, const ovsdb_message_parser_t * parser, const char * str)
+{
+    const ctl_command_t *command;
+    char                 result[CTL_RESULT_SIZE] = "";
+    char                 id[32] = "null";
+    char                 arg[CTL_ARG_SIZE];
+    char                *response = client->response + client->response_size;
+    size_t               size = sizeof(client->response) - client->response_size;
+    int                  rc = -1;
+    int                  count;
+    int                  escaped;
+
+    if (parser->id >= 0) {
+        snprintf(id, sizeof(id), "%ld", parser->id);
+    }
+
+    if (parser->method < 0) {
+        snprintf(result, sizeof(result), "method is not specified");
+    }
+    else {
+        for (command = g_commands; command->name != NULL; ++command) {
+            if (is_json_token_equal_to_str(str, (jsmntok_t *)&parser->t[parser->method], command->name)) {
+                break;
+            }
+        }
+
+        if (command->name == NULL) {
+            snprintf(result, sizeof(result), "\"%.*s\" is not a valid command",
+                parser->t[parser->method].end - parser->t[parser->method].start, str + parser->t[parser->method].start);
+        }
+        else {
+            get_first_param(parser, str, arg, sizeof(arg));
+            LOG_DBG("control command \"%s\" (%s)", command->name, arg);
+            rc = command->handler(arg, result, sizeof(result));
+        }
+    }
+
+    /* {"id":ID,"result":"...","error":null} or {"id":ID,"result":null,"error":"..."} */
+    count = snprintf(response, size, "{\"id\":%s,\"%s\":", id, rc == 0? "error\":null,\"result": "result\":null,\"error");
+    if (count < 0 || (size_t)count >= size) {
+        LOG_ERROR("no space left for control response");
+        return;
+    }
+
+    escaped = json_write_str(response + count, size - count - 1, result);
+    if (escaped < 0) {
+        LOG_ERROR("no space left for control response");
+        return;
+    }
+
+    count += escaped;
+    response[count++] = '}';
+    client->response_size += count;
+}
+
+static void client_close(int index)
+{
+    loop_del_fd(g_ctl.clients[index].fd);
+    close(g_ctl.clients[index].fd);
+
+    g_ctl.clients[index] = g_ctl.clients[--g_ctl.clients_count];
+
+    if (g_ctl.fd != -1 && g_ctl.clients_count == MAX_CTL_CLIENTS - 1) {
+        loop_mod_fd(g_ctl.fd, EPOLLIN);
+    }
+}
+
+/* Returns 1 if client has to be closed */
+static int client_send(ctl_client_t * client)
+{
+    ssize_t count;
+
+    count = send(client->fd, client->response + client->sent, client->response_size - client->sent, MSG_DONTWAIT | MSG_NOSIGNAL);
+    if (count < 0) {
+        return errno != EAGAIN && errno != EINTR;
+    }
+
+    client->sent += count;
+    if (client->sent == client->response_size) {
+        client->sent = 0;
+        client->response_size = 0;
+    }
+
+    return 0;
+}
+
+/* Returns 1 if client has to be closed */
+static int client_receive(ctl_client_t * client)
+{
+    ovsdb_message_parser_t parser;
+    ssize_t                count;
+
+    count = recv(client->fd, client->request + client->size, sizeof(client->request) - client->size - 1, MSG_DONTWAIT);
+    if (count < 0) {
+        return errno != EAGAIN && errno != EINTR;
+    }
+
+    if (count == 0) {
+        return 1;
+    }
+
+    client->size += count;
+    client->request[client->size] = '\0';
+
+    while (client->size > 0 && parse_jrpc(&parser, client->request)) {
+        client_respond(client, &parser, client->request);
+
+        client->size -= (parser.end - client->request);
+        memmove(client->request, parser.end, client->size + 1);
+    }
+
+    if (client->size == sizeof(client->request) - 1) {
+        LOG_ERROR("control request is too long");
+        return 1;
+    }
+
+    return client->response_size? client_send(client): 0;
+}
+
+static void on_client_event(int fd, uint32_t events, void * ctx)
+{
+    (void)events;
+    (void)ctx;
+
+    for (int i = 0; i < g_ctl.clients_count; ++i) {
+        ctl_client_t *client = &g_ctl.clients[i];
+
+        if (client->fd != fd) {
+            continue;
+        }
+
+        if (client->response_size? client_send(client): client_receive(client)) {
+            client_close(i);
+        }
+        else {
+            /* requests are not read until the response is sent */
+            loop_mod_fd(fd, client->response_size? EPOLLOUT: EPOLLIN);
+        }
+        break;
+    }
+}
+
+static void on_accept(int listen_fd, uint32_t events, void * ctx)
+{
+    ctl_client_t *client;
+    int           fd;
+
+    (void)events;
+    (void)ctx;
+
+    fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0) {
+        if (errno != EAGAIN) {
+            LOG_ERROR("failed to accept control client: %d (%s)", errno, strerror(errno));
+        }
+        return;
+    }
+
+    if (loop_add_fd(fd, EPOLLIN, on_client_event, NULL) != 0) {
+        close(fd);
+        return;
+    }
+
+    client = &g_ctl.clients[g_ctl.clients_count++];
+    client->fd            = fd;
+    client->size          = 0;
+    client->response_size = 0;
+    client->sent          = 0;
+
+    /* stop accepting while all client slots are busy */
+    if (g_ctl.clients_count == MAX_CTL_CLIENTS) {
+        loop_mod_fd(listen_fd, 0);
+    }
+}
+
+int ctl_init(const char * sock_path, const ctl_handlers_t * handlers)
+{
+    int error;
+
+    g_ctl.handlers = handlers;
+
+    if (sock_path[0] == '\0') {
+        return 0;
+    }
+
+    error = listen_unix_socket(sock_path, &g_ctl.fd);
+    if (error) {
+        g_ctl.fd = -1;
+        return error;
+    }
+
+    error = loop_add_fd(g_ctl.fd, EPOLLIN, on_accept, NULL);
+    if (error) {
+        close(g_ctl.fd);
+        g_ctl.fd = -1;
+        return error;
+    }
+
+    LOG_INFO("listening for control commands on \"%s\"", sock_path);
+    return 0;
+}
+
+void ctl_done(void)
+{
+    while (g_ctl.clients_count) {
+        client_close(0);
+    }
+
+    if (g_ctl.fd != -1) {
+        loop_del_fd(g_ctl.fd);
+        close(g_ctl.fd);
+        g_ctl.fd = -1;
+    }
+}
@@ -0,0 +1,54 @@
+/*
+################################################################################
+#
+#  Copyright 2020-2021 Inango Systems Ltd.
+#
+#  Licensed under the Apache License, Version 2.0 (the "License");
+#  you may not use this file except in compliance with the License.
+#  You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+#  Unless required by applicable law or agreed to in writing, software
+#  distributed under the License is distributed on an "AS IS" BASIS,
+#  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+#  See the License for the specific language governing permissions and
+#  limitations under the License.
+#
+################################################################################
+*/
+#ifndef CHANDLER_CTL_H
+#define CHANDLER_CTL_H
+
+#define MAX_CTL_CLIENTS       4
+#define CTL_REQUEST_SIZE      4096
+#define CTL_RESPONSE_SIZE     8192
+
+/* Actions which are implemented by the main loop */
+typedef struct ctl_handlers_t {
+    void (* on_check_now)(void);               // schedules the check of daemons
+    int  (* on_reload)(void);                  // reloads configuration, returns 0 on success
+} ctl_handlers_t;
+
+/**
+ * Starts listening on the unix socket for JSON-RPC requests in the same
+ * format as used by ovs-appctl, so that chandler can be controlled with
+ * "ovs-appctl -t SOCKET COMMAND".
+ *
+ * Supported commands: list-commands, status, check-now, log/set LEVEL,
+ * stats/reset, reload. Descriptors are served by the event loop, so
+ * loop_init() goes first.
+ *
+ * \param sock_path  Path of the unix socket (empty string - control socket disabled)
+ * \param handlers   Handlers of commands implemented by the main loop
+ *
+ * \return           0 on success or if disabled, errno value - otherwise
+ */
+int  ctl_init(const char * sock_path, const ctl_handlers_t * handlers);
+
+/**
+ * Closes the listener and all client connections.
+ */
+void ctl_done(void);
+
+#endif  /* CHANDLER_CTL_H */
@@ -0,0 +1,154 @@
+/*
+################################################################################
+#
+#  Copyright 2020-2021 Inango Systems Ltd.
+#
+#  Licensed under the Apache License, Version 2.0 (the "License");
+#  you may not use this file except in compliance with the License.
+#  You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+#  Unless required by applicable law or agreed to in writing, software
+#  distributed under the License is distributed on an "AS IS" BASIS,
+#  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+#  See the License for the specific language governing permissions and
+#  limitations under the License.
+#
+################################################################################
+*/
+#define _GNU_SOURCE
+
+#include "chandler_escalation.h"
+
+#include "chandler_conf.h"
+#include "chandler_log.h"
+#include "chandler_system.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+static const char * const g_action_names[] = {
+    [EA_RESTART]     = "restart",
+    [EA_RESTART_ALL] = "restart_all",
+    [EA_COMMAND]     = "command",
+    [EA_REBOOT]      = "reboot"
+};
+
+typedef struct escalation_ladder_t {
+    char               spec[MAX_ESCALATION_SIZE];  // specification the steps have been parsed from
+    escalation_step_t  steps[MAX_ESCALATION_STEPS];
+    size_t             count;
+    unsigned long      generation;                 // incremented every time the ladder is parsed
+} escalation_ladder_t;
+
+
+static escalation_ladder_t g_ladder;
+
+
+const char * escalation_action_name(escalation_action_t action)
+{
+    return g_action_names[action];
+}
+
+static int parse_action(const char * name, size_t length, escalation_action_t * action)
+{
+    for (size_t i = 0; i < sizeof(g_action_names) / sizeof(g_action_names[0]); ++i) {
+        if (strlen(g_action_names[i]) == length && 0 == strncmp(name, g_action_names[i], length)) {
+            *action = (escalation_action_t)i;
+            return 0;
+        }
+    }
+
+    return EINVAL;
+}
+
+int escalation_parse(const char * spec, escalation_step_t * steps, size_t * count)
+{
+    const char *p = spec;
+    size_t      length;
+    char       *number_end;
+
+    *count = 0;
+
+    while (*p != '\0') {
+        p += strspn(p, " ");
+        length = strcspn(p, ":, ");
+
+        if (*count == MAX_ESCALATION_STEPS || parse_action(p, length, &steps[*count].action)) {
+            return EINVAL;
+        }
+
+        p += length;
+        steps[*count].window = ESCALATION_WINDOW_MSEC;
+
+        if (*p == ':') {
+            steps[*count].window = strtol(p + 1, &number_end, 10);
+            if (number_end == p + 1 || steps[*count].window < 0) {
+                return EINVAL;
+            }
+            p = number_end;
+        }
+
+        p += strspn(p, " ");
+        if (*p == ',') {
+            ++p;
+        }
+        else if (*p != '\0') {
+            return EINVAL;
+        }
+
+        ++*count;
+    }
+
+    return *count? 0: EINVAL;
+}
+
+static void load_ladder(void)
+{
+    const char *spec = get_conf()->escalation;
+
+    if (0 == strcmp(spec, g_ladder.spec) && g_ladder.count) {
+        return;
+    }
+
+    snprintf(g_ladder.spec, sizeof(g_ladder.spec), "%s", spec);
+    g_ladder.generation += 1;
+
+    if (escalation_parse(spec, g_ladder.steps, &g_ladder.count)) {
+        LOG_ERROR("invalid escalation ladder \"%s\" - only restarts are used", spec);
+        g_ladder.steps[0].action = EA_RESTART;
+        g_ladder.steps[0].window = 0;
+        g_ladder.count = 1;
+    }
+}
+
+escalation_action_t escalation_next(escalation_state_t * state, const char * name, uint64_t now)
+{
+    const escalation_step_t *step;
+
+    load_ladder();
+
+    if (   state->generation != g_ladder.generation
+        || now - state->step_time > (uint64_t)g_ladder.steps[state->step].window * 1000
+    )
+    {
+        state->step = 0;
+    }
+    else if ((size_t)state->step + 1 < g_ladder.count) {
+        ++state->step;
+    }
+
+    state->generation = g_ladder.generation;
+    state->step_time  = now;
+    step = &g_ladder.steps[state->step];
+
+    if (state->step > 0) {
+        LOG_WARN("escalating recovery of \"%s\" to step %ld: %s", name, state->step + 1, escalation_action_name(step->action));
+    }
+
+    return step->action;
+}
@@ -0,0 +1,81 @@
+/*
+################################################################################
+#
+#  Copyright 2020-2021 Inango Systems Ltd.
+#
+#  Licensed under the Apache License, Version 2.0 (the "License");
+#  you may not use this file except in compliance with the License.
+#  You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+#  Unless required by applicable law or agreed to in writing, software
+#  distributed under the License is distributed on an "AS IS" BASIS,
+#  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+#  See the License for the specific language governing permissions and
+#  limitations under the License.
+#
+################################################################################
+*/
+#ifndef CHANDLER_ESCALATION_H
+#define CHANDLER_ESCALATION_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define MAX_ESCALATION_STEPS  8
+
+/* Recovery actions in the order they are usually escalated */
+typedef enum escalation_action_t {
+    EA_RESTART,                        // restart the failing daemon
+    EA_RESTART_ALL,                    // restart all daemons in dependency order
+    EA_COMMAND,                        // run ovs_cmd_remediate
+    EA_REBOOT                          // reboot the system
+} escalation_action_t;
+
+typedef struct escalation_step_t {
+    escalation_action_t action;
+    long                window;        // msec, a failure within this period after the step escalates to the next one
+} escalation_step_t;
+
+/* Position of a service on the ladder, zeroed state means no step has been taken */
+typedef struct escalation_state_t {
+    long               step;               // index of the last taken step
+    uint64_t           step_time;          // time when the last step has been taken in usec
+    unsigned long      generation;         // ladder the step belongs to (steps are reset when it is reloaded)
+} escalation_state_t;
+
+/**
+ * Parses the ladder in format "ACTION[:WINDOW],ACTION[:WINDOW],...", where
+ * ACTION is one of restart, restart_all, command, reboot and WINDOW is in
+ * msec (ESCALATION_WINDOW_MSEC if omitted).
+ *
+ * \param spec        Ladder specification
+ * \param[out] steps  Array of MAX_ESCALATION_STEPS steps
+ * \param[out] count  Number of parsed steps
+ *
+ * \return            0 - on success, EINVAL - on error
+ */
+int  escalation_parse(const char * spec, escalation_step_t * steps, size_t * count);
+
+/**
+ * Picks the action to recover from a failure of a service. The ladder goes
+ * back to the first step if the previous step of the service has not been
+ * followed by another failure within its window, otherwise it goes one step
+ * up (the last step repeats). The ladder is taken from the escalation option
+ * and is parsed again when the option changes.
+ *
+ * \param state  Position of the failing service on the ladder
+ * \param name   Name of the service
+ * \param now    Monotonic time of the failure in usec
+ *
+ * \return       Action to take
+ */
+escalation_action_t escalation_next(escalation_state_t * state, const char * name, uint64_t now);
+
+/**
+ * Returns name of the action as it is used in configuration.
+ */
+const char * escalation_action_name(escalation_action_t action);
+
+#endif  /* CHANDLER_ESCALATION_H */
@@ -0,0 +1,347 @@
+/*
+################################################################################
+#
+#  Copyright 2020-2021 Inango Systems Ltd.
+#
+#  Licensed under the Apache License, Version 2.0 (the "License");
+#  you may not use this file except in compliance with the License.
+#  You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+#  Unless required by applicable law or agreed to in writing, software
+#  distributed under the License is distributed on an "AS IS" BASIS,
+#  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+#  See the License for the specific language governing permissions and
+#  limitations under the License.
+#
+################################################################################
+*/
+#define _GNU_SOURCE
+
+#include "chandler_event.h"
+
+#include "chandler_json.h"
+#include "chandler_log.h"
+#include "chandler_loop.h"
+#include "chandler_system.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+
+typedef struct event_record_t {
+    size_t  size;
+    char    data[EVENT_SIZE];
+} event_record_t;
+
+typedef struct event_subscriber_t {
+    int       fd;
+    uint64_t  next_seq;                        // sequence number of the next event to be sent
+    size_t    pending_size;                    // number of bytes in pending buffer
+    size_t    pending_sent;                    // number of bytes of pending buffer already sent
+    char      pending[EVENT_SIZE];             // partially sent event or overflow notice
+} event_subscriber_t;
+
+typedef struct event_stream_t {
+    int                 fd;
+    uint64_t            seq;                   // sequence number of the next emitted event
+    event_record_t      ring[EVENT_RING_SIZE]; // event with sequence number N is stored at N % EVENT_RING_SIZE
+    event_subscriber_t  subscribers[MAX_EVENT_SUBSCRIBERS];
+    int                 subscribers_count;
+} event_stream_t;
+
+
+static event_stream_t g_events = {.fd = -1, .seq = 1};
+
+
+static const char * event_name(chandler_event_type_t type)
+{
+    switch (type)
+    {
+    case EV_PROBE_FAILURE:
+        return "probe-failure";
+    case EV_KILL:
+        return "kill";
+    case EV_SPAWN:
+        return "spawn";
+    case EV_READY:
+        return "ready";
+    case EV_DISCONNECT:
+        return "disconnect";
+    case EV_SLOW:
+        return "slow";
+    case EV_ESCALATE:
+        return "escalate";
+    case EV_EXIT:
+        return "exit";
+    case EV_OOM_KILL:
+        return "oom-kill";
+    case EV_THROTTLE:
+        return "throttle";
+    case EV_LEAK:
+        return "leak";
+    case EV_BUSY:
+        return "busy";
+    case EV_STUCK:
+        return "stuck";
+    default:
+        return "reboot";
+    }
+}
+
+static uint64_t oldest_seq(void)
+{
+    return g_events.seq > EVENT_RING_SIZE? g_events.seq - EVENT_RING_SIZE: 1;
+}
+
+/* Returns -1 on error, 0 if the socket is full, 1 if all data has been sent */
+static int subscriber_send(event_subscriber_t * subscriber, const char * data, size_t size)
+{
+    ssize_t count;
+
+    count = send(subscriber->fd, data, size, MSG_DONTWAIT | MSG_NOSIGNAL);
+    if (count < 0) {
+        return (errno == EAGAIN || errno == EINTR)? 0: -1;
+    }
+
+    if ((size_t)count < size) {
+        /* keep the rest in own buffer: the ring slot may be overwritten meanwhile */
+        memmove(subscriber->pending, data + count, size - count);
+        subscriber->pending_size = size - count;
+        subscriber->pending_sent = 0;
+        return 0;
+    }
+
+    return 1;
+}
+
+/* Returns 1 if subscriber has to be closed */
+static int subscriber_flush(event_subscriber_t * subscriber)
+{
+    event_record_t *record;
+    uint64_t        lost;
+    int             rc;
+
+    if (subscriber->pending_size) {
+        rc = subscriber_send(subscriber, subscriber->pending + subscriber->pending_sent, subscriber->pending_size - subscriber->pending_sent);
+        if (rc < 0) {
+            return 1;
+        }
+
+        if (rc == 0) {
+            /* socket is full - either partially sent (pending buffer is updated) or nothing sent */
+            return 0;
+        }
+
+        subscriber->pending_size = 0;
+    }
+
+    if (subscriber->next_seq < oldest_seq()) {
+        lost = oldest_seq() - subscriber->next_seq;
+        subscriber->next_seq = oldest_seq();
+        subscriber->pending_size = snprintf(subscriber->pending, sizeof(subscriber->pending),
+            "{\"seq\":%lu,\"event\":\"overflow\",\"lost\":%lu}\n", (unsigned long)subscriber->next_seq, (unsigned long)lost);
+        subscriber->pending_sent = 0;
+
+        LOG_WARN("event subscriber is too slow - %lu events are lost", (unsigned long)lost);
+        return subscriber_flush(subscriber);
+    }
+
+    while (subscriber->next_seq < g_events.seq) {
+        record = &g_events.ring[subscriber->next_seq % EVENT_RING_SIZE];
+
+        rc = subscriber_send(subscriber, record->data, record->size);
+        if (rc < 0) {
+            return 1;
+        }
+
+        if (rc == 0 && subscriber->pending_size == 0) {
+            /* nothing was sent */
+            return 0;
+        }
+
+        ++subscriber->next_seq;
+
+        if (rc == 0) {
+            return 0;
+        }
+    }
+
+    return 0;
+}
+
+static int has_backlog(const event_subscriber_t * subscriber)
+{
+    return subscriber->pending_size || subscriber->next_seq < g_events.seq;
+}
+
+/* Subscribers are not expected to send anything: EPOLLIN reports hangup */
+static void subscriber_watch(const event_subscriber_t * subscriber)
+{
+    loop_mod_fd(subscriber->fd, has_backlog(subscriber)? EPOLLOUT: EPOLLIN);
+}
+
+static void subscriber_close(int index)
+{
+    loop_del_fd(g_events.subscribers[index].fd);
+    close(g_events.subscribers[index].fd);
+
+    g_events.subscribers[index] = g_events.subscribers[--g_events.subscribers_count];
+
+    if (g_events.fd != -1 && g_events.subscribers_count == MAX_EVENT_SUBSCRIBERS - 1) {
+        loop_mod_fd(g_events.fd, EPOLLIN);
+    }
+}
+
+static void on_subscriber_event(int fd, uint32_t events, void * ctx)
+{
+    char discard[256];
+
+    (void)ctx;
+
+    for (int i = 0; i < g_events.subscribers_count; ++i) {
+        event_subscriber_t *subscriber = &g_events.subscribers[i];
+
+        if (subscriber->fd != fd) {
+            continue;
+        }
+
+        if (events & EPOLLOUT) {
+            if (subscriber_flush(subscriber)) {
+                subscriber_close(i);
+            }
+            else {
+                subscriber_watch(subscriber);
+            }
+        }
+        else if (recv(fd, discard, sizeof(discard), MSG_DONTWAIT) == 0 || (events & (EPOLLERR | EPOLLHUP))) {
+            LOG_DBG("event subscriber has disconnected");
+            subscriber_close(i);
+        }
+        break;
+    }
+}
+
+static void on_accept(int listen_fd, uint32_t events, void * ctx)
+{
+    event_subscriber_t *subscriber;
+    int                 fd;
+
+    (void)events;
+    (void)ctx;
+
+    fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0) {
+        if (errno != EAGAIN) {
+            LOG_ERROR("failed to accept event subscriber: %d (%s)", errno, strerror(errno));
+        }
+        return;
+    }
+
+    if (loop_add_fd(fd, EPOLLIN, on_subscriber_event, NULL) != 0) {
+        close(fd);
+        return;
+    }
+
+    subscriber = &g_events.subscribers[g_events.subscribers_count++];
+    subscriber->fd           = fd;
+    subscriber->next_seq     = g_events.seq;
+    subscriber->pending_size = 0;
+    subscriber->pending_sent = 0;
+
+    /* stop accepting while all subscriber slots are busy */
+    if (g_events.subscribers_count == MAX_EVENT_SUBSCRIBERS) {
+        loop_mod_fd(listen_fd, 0);
+    }
+
+    LOG_DBG("accepted event subscriber");
+}
+
+void event_emit(chandler_event_type_t type, const char * daemon, const char * detail)
+{
+    event_record_t  *record = &g_events.ring[g_events.seq % EVENT_RING_SIZE];
+    struct timespec  ts;
+    int              count;
+    int              escaped;
+
+    if (g_events.fd == -1) {
+        return;
+    }
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+
+    count = snprintf(record->data, sizeof(record->data), "{\"seq\":%lu,\"time\":%ld.%03ld,\"event\":\"%s\"",
+        (unsigned long)g_events.seq, (long)ts.tv_sec, ts.tv_nsec / 1000000, event_name(type));
+
+    if (daemon != NULL) {
+        count += snprintf(record->data + count, sizeof(record->data) - count, ",\"daemon\":");
+        escaped = json_write_str(record->data + count, sizeof(record->data) - count, daemon);
+        count += (escaped > 0)? escaped: snprintf(record->data + count, sizeof(record->data) - count, "null");
+    }
+
+    if (detail != NULL) {
+        count += snprintf(record->data + count, sizeof(record->data) - count, ",\"detail\":");
+        /* keep room for the closing brace and the newline */
+        escaped = json_write_str(record->data + count, sizeof(record->data) - count - 2, detail);
+        count += (escaped > 0)? escaped: snprintf(record->data + count, sizeof(record->data) - count, "null");
+    }
+
+    record->data[count++] = '}';
+    record->data[count++] = '\n';
+    record->size = count;
+
+    ++g_events.seq;
+
+    for (int i = 0; i < g_events.subscribers_count; ++i) {
+        if (subscriber_flush(&g_events.subscribers[i])) {
+            subscriber_close(i--);
+        }
+        else {
+            subscriber_watch(&g_events.subscribers[i]);
+        }
+    }
+}
+
+int event_init(const char * sock_path)
+{
+    int error;
+
+    if (sock_path[0] == '\0') {
+        return 0;
+    }
+
+    error = listen_unix_socket(sock_path, &g_events.fd);
+    if (error) {
+        g_events.fd = -1;
+        return error;
+    }
+
+    error = loop_add_fd(g_events.fd, EPOLLIN, on_accept, NULL);
+    if (error) {
+        close(g_events.fd);
+        g_events.fd = -1;
+        return error;
+    }
+
+    LOG_INFO("publishing events on \"%s\"", sock_path);
+    return 0;
+}
+
+void event_done(void)
+{
+    while (g_events.subscribers_count) {
+        subscriber_close(0);
+    }
+
+    if (g_events.fd != -1) {
+        loop_del_fd(g_events.fd);
+        close(g_events.fd);
+        g_events.fd = -1;
+    }
+}
@@ -0,0 +1,73 @@
+/*
+################################################################################
+#
+#  Copyright 2020-2021 Inango Systems Ltd.
+#
+#  Licensed under the Apache License, Version 2.0 (the "License");
+#  you may not use this file except in compliance with the License.
+#  You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+#  Unless required by applicable law or agreed to in writing, software
+#  distributed under the License is distributed on an "AS IS" BASIS,
+#  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+#  See the License for the specific language governing permissions and
+#  limitations under the License.
+#
+################################################################################
+*/
+#ifndef CHANDLER_EVENT_H
+#define CHANDLER_EVENT_H
+
+#define MAX_EVENT_SUBSCRIBERS   4
+#define EVENT_RING_SIZE         64
+#define EVENT_SIZE              512
+
+typedef enum chandler_event_type_t {
+    EV_PROBE_FAILURE,
+    EV_KILL,
+    EV_SPAWN,
+    EV_READY,
+    EV_DISCONNECT,
+    EV_REBOOT,
+    EV_SLOW,
+    EV_ESCALATE,
+    EV_EXIT,
+    EV_OOM_KILL,
+    EV_THROTTLE,
+    EV_LEAK,
+    EV_BUSY,
+    EV_STUCK
+} chandler_event_type_t;
+
+/**
+ * Starts listening on the unix socket for event subscribers.
+ *
+ * Every subscriber receives newline-delimited JSON objects like
+ * {"seq":1,"time":1600000000.123,"event":"kill","daemon":"ovs-vswitchd","detail":"..."}
+ * for all events emitted after it has connected. Events are kept in a shared
+ * ring: subscriber which does not read fast enough loses the oldest events
+ * and gets {"seq":N,"event":"overflow","lost":COUNT} instead of them.
+ *
+ * \param sock_path  Path of the unix socket (empty string - events are not exported)
+ *
+ * \return           0 on success or if disabled, errno value - otherwise
+ */
+int  event_init(const char * sock_path);
+
+/**
+ * Closes the listener and all subscriber connections.
+ */
+void event_done(void);
+
+/**
+ * Emits an event to all subscribers.
+ *
+ * \param type    Type of the event
+ * \param daemon  Name of the related daemon or NULL
+ * \param detail  Human readable details or NULL
+ */
+void event_emit(chandler_event_type_t type, const char * daemon, const char * detail);
+
+#endif  /* CHANDLER_EVENT_H */
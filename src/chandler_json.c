@@ -18,6 +18,7 @@
 ################################################################################
 */
 
+#include <stdio.h>
 #include <string.h>
 
 /* Implementation wrapper for jsmn library */
@@ -116,3 +117,61 @@ int json_next_index(jsmntok_t * tokens, int count, int index)
 
     return index + token_weight(tokens + index, count - index);
 }
+
+int json_write_str(char * buffer, size_t size, const char * s)
+{
+    size_t pos = 0;
+    char   escaped[8];
+    size_t escaped_size;
+
+    if (size < 3) {
+        return -1;
+    }
+
+    buffer[pos++] = '"';
+
+    for (; *s; ++s) {
+        switch (*s)
+        {
+        case '"':
+        case '\\':
+            escaped[0] = '\\';
+            escaped[1] = *s;
+            escaped_size = 2;
+            break;
+        case '\n':
+            memcpy(escaped, "\\n", 2);
+            escaped_size = 2;
+            break;
+        case '\r':
+            memcpy(escaped, "\\r", 2);
+            escaped_size = 2;
+            break;
+        case '\t':
+            memcpy(escaped, "\\t", 2);
+            escaped_size = 2;
+            break;
+        default:
+            if ((unsigned char)*s < 0x20) {
+                escaped_size = snprintf(escaped, sizeof(escaped), "\\u%04x", (unsigned char)*s);
+            }
+            else {
+                escaped[0] = *s;
+                escaped_size = 1;
+            }
+        }
+
+        /* room for the closing quote and the terminating null is kept */
+        if (pos + escaped_size + 2 > size) {
+            return -1;
+        }
+
+        memcpy(buffer + pos, escaped, escaped_size);
+        pos += escaped_size;
+    }
+
+    buffer[pos++] = '"';
+    buffer[pos]   = '\0';
+
+    return (int)pos;
+}
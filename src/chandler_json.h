@@ -24,6 +24,8 @@
 #define JSMN_HEADER
 #include "jsmn.h"
 
+#include <stddef.h>
+
 /**
  * Checks the token is of string type and compares its value to provided string
  * \arg s.
@@ -70,4 +72,16 @@ int is_json_token_equal_to_null(const char * json, jsmntok_t * token);
  */
 int json_next_index(jsmntok_t * tokens, int count, int index);
 
+/**
+ * Writes \arg s as a quoted JSON string, escaping special characters.
+ *
+ * \param buffer  Output buffer
+ * \param size    Size of the output buffer
+ * \param s       String to be written
+ *
+ * \return        Number of written characters (not including the terminating
+ *                null), or -1 if the buffer is too small
+ */
+int json_write_str(char * buffer, size_t size, const char * s);
+
 #endif  /* CHANDLER_JSON_H */
@@ -20,11 +20,18 @@
 #define _GNU_SOURCE  /* => _POSIX_C_SOURCE >= 199309L */
 
 #include <stdarg.h>
+#include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 #include <time.h>
 #include <unistd.h>
 
+/* Syslog output support */
+#include <stddef.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+
 /* File output support */
 #include <linux/limits.h>
 #include <stdint.h>
@@ -38,16 +45,51 @@
         .file_name         = "",                \
         .log_to_console    = 1,                 \
         .log_to_file       = 0,                 \
+        .log_to_syslog     = 0,                 \
         .file_size_limit   = MAX_LOG_FILE_SIZE, \
-        .rotate_file_count = 1                  \
+        .rotate_file_count = 1,                 \
+        .ring_size         = 0                  \
     }
 
 
+/* Values from <syslog.h>, which can't be included because of LOG_XXX macros clash */
+#define SYSLOG_FACILITY_DAEMON    (3 << 3)
+#define SYSLOG_SEVERITY_ERR       3
+#define SYSLOG_SEVERITY_WARNING   4
+#define SYSLOG_SEVERITY_INFO      6
+#define SYSLOG_SEVERITY_DEBUG     7
+
+/* Minimal interval between attempts to reconnect to the syslog socket */
+#define SYSLOG_RECONNECT_SEC      1
+
+
+typedef struct syslog_queue_t
+{
+    int     fd;
+    pid_t   pid;
+    long    last_connect_sec;
+    size_t  head;                                              // index of the oldest queued record
+    size_t  count;                                             // number of queued records
+    size_t  sizes[SYSLOG_QUEUE_SIZE];
+    char    records[SYSLOG_QUEUE_SIZE][SYSLOG_RECORD_SIZE];
+} syslog_queue_t;
+
+typedef struct log_ring_t
+{
+    char   *buffer;
+    size_t  size;
+    size_t  head;                                              // offset of the oldest record
+    size_t  used;                                              // number of bytes occupied by records
+} log_ring_t;
+
 typedef struct logger_t
 {
     chandler_log_conf_t  conf;
+    chandler_log_stat_t  stat;
     size_t          file_name_len;
     FILE           *file;
+    syslog_queue_t  syslog;
+    log_ring_t      ring;
 } logger_t;
 
 
@@ -57,8 +99,11 @@ static FILE      *g_log_stream = NULL;
 
 static logger_t   g_logger     = {
     .conf           = LOG_CONF_DEFAULTS,
+    .stat           = {0, 0},
     .file_name_len = 0,
-    .file           = NULL
+    .file           = NULL,
+    .syslog         = {.fd = -1, .last_connect_sec = -SYSLOG_RECONNECT_SEC},
+    .ring           = {NULL, 0, 0, 0}
 };
 
 
@@ -176,15 +221,204 @@ static void log_file_write(const char * message, size_t size)
     }
 }
 /*--------------------------------------------------------------------------*/
+/* in-memory ring support */
+/*--------------------------------------------------------------------------*/
+static void log_ring_drop_oldest(void)
+{
+    log_ring_t *ring = &g_logger.ring;
+    size_t      tail = ring->size - ring->head;
+    char       *end;
+    size_t      dropped;
+
+    /* every record is terminated by '\n' which may be located after wrap */
+    end = memchr(ring->buffer + ring->head, '\n', ring->used < tail? ring->used: tail);
+    if (end != NULL) {
+        dropped = end - (ring->buffer + ring->head) + 1;
+    }
+    else {
+        end = memchr(ring->buffer, '\n', ring->used - tail);
+        dropped = (end != NULL)? tail + (end - ring->buffer) + 1: ring->used;
+    }
+
+    ring->head  = (ring->head + dropped) % ring->size;
+    ring->used -= dropped;
+}
+/*--------------------------------------------------------------------------*/
+static void log_ring_copy_in(const char * data, size_t size)
+{
+    log_ring_t *ring  = &g_logger.ring;
+    size_t      pos   = (ring->head + ring->used) % ring->size;
+    size_t      first = ring->size - pos;
+
+    if (first > size)
+        first = size;
+
+    memcpy(ring->buffer + pos, data, first);
+    memcpy(ring->buffer, data + first, size - first);
+    ring->used += size;
+}
+/*--------------------------------------------------------------------------*/
+static void log_ring_write(const char * message, size_t size)
+{
+    log_ring_t *ring = &g_logger.ring;
+
+    if (size > ring->size - 1)
+        size = ring->size - 1;
+
+    while (ring->used + size + 1 > ring->size)
+        log_ring_drop_oldest();
+
+    log_ring_copy_in(message, size);
+    log_ring_copy_in("\n", 1);
+}
+/*--------------------------------------------------------------------------*/
+static void log_ring_flush(void)
+{
+    log_ring_t *ring = &g_logger.ring;
+    size_t      first;
+
+    if (ring->used == 0)
+        return;
+
+    if (NULL == g_logger.file)
+        log_file_open();
+
+    if (NULL != g_logger.file)
+    {
+        first = ring->size - ring->head;
+        if (first > ring->used)
+            first = ring->used;
+
+        log_file_rotate_if_needed(ring->used);
+        fwrite(ring->buffer + ring->head, 1, first, g_logger.file);
+        fwrite(ring->buffer, 1, ring->used - first, g_logger.file);
+        fflush(g_logger.file);
+    }
+
+    ring->head = 0;
+    ring->used = 0;
+}
+/*--------------------------------------------------------------------------*/
+/* syslog output support */
+/*--------------------------------------------------------------------------*/
+static int log_syslog_severity(long level)
+{
+    switch (level)
+    {
+    case CHANDLER_LOG_LEVEL_ERR_ID:
+        return SYSLOG_SEVERITY_ERR;
+    case CHANDLER_LOG_LEVEL_WRN_ID:
+        return SYSLOG_SEVERITY_WARNING;
+    case CHANDLER_LOG_LEVEL_INF_ID:
+        return SYSLOG_SEVERITY_INFO;
+    default:
+        return SYSLOG_SEVERITY_DEBUG;
+    }
+}
+/*--------------------------------------------------------------------------*/
+static void log_syslog_close(void)
+{
+    if (g_logger.syslog.fd != -1) {
+        close(g_logger.syslog.fd);
+        g_logger.syslog.fd = -1;
+    }
+}
+/*--------------------------------------------------------------------------*/
+static int log_syslog_open(void)
+{
+    struct sockaddr_un un = {.sun_family = AF_UNIX, .sun_path = SYSLOG_SOCKET_PATH};
+    long               sec;
+    int                msec;
+
+    if (g_logger.syslog.fd != -1)
+        return 0;
+
+    /* do not hammer the socket when syslog daemon is not running */
+    chandler_get_time(&sec, &msec);
+    if (sec - g_logger.syslog.last_connect_sec < SYSLOG_RECONNECT_SEC)
+        return 1;
+
+    g_logger.syslog.last_connect_sec = sec;
+
+    g_logger.syslog.fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (g_logger.syslog.fd == -1)
+        return 1;
+
+    if (connect(g_logger.syslog.fd, (struct sockaddr *)&un, sizeof(un)) != 0) {
+        log_syslog_close();
+        return 1;
+    }
+
+    return 0;
+}
+/*--------------------------------------------------------------------------*/
+static void log_syslog_drop(size_t count)
+{
+    g_logger.stat.syslog_dropped += count;
+    g_logger.syslog.head   = (g_logger.syslog.head + count) % SYSLOG_QUEUE_SIZE;
+    g_logger.syslog.count -= count;
+}
+/*--------------------------------------------------------------------------*/
+static void log_syslog_write(long level, const char * message, size_t size)
+{
+    size_t     index;
+    char      *record;
+    int        count;
+    time_t     now;
+    struct tm  tm;
+    char       timestamp[16];
+
+    if (g_logger.syslog.count == SYSLOG_QUEUE_SIZE) {
+        chandler_log_flush();
+        if (g_logger.syslog.count == SYSLOG_QUEUE_SIZE) {
+            g_logger.stat.syslog_dropped += 1;
+            return;
+        }
+    }
+
+    if (g_logger.syslog.pid == 0)
+        g_logger.syslog.pid = getpid();
+
+    index  = (g_logger.syslog.head + g_logger.syslog.count) % SYSLOG_QUEUE_SIZE;
+    record = g_logger.syslog.records[index];
+
+    /* RFC 3164 header, the same as produced by syslog(3) */
+    now = time(NULL);
+    localtime_r(&now, &tm);
+    strftime(timestamp, sizeof(timestamp), "%b %e %T", &tm);
+
+    count = snprintf(record, SYSLOG_RECORD_SIZE, "<%d>%s chandler[%d]: ",
+        SYSLOG_FACILITY_DAEMON | log_syslog_severity(level), timestamp, (int)g_logger.syslog.pid);
+    if (count < 0 || count >= SYSLOG_RECORD_SIZE) {
+        g_logger.stat.syslog_dropped += 1;
+        return;
+    }
+
+    if (size > (size_t)(SYSLOG_RECORD_SIZE - count))
+        size = SYSLOG_RECORD_SIZE - count;
+
+    memcpy(record + count, message, size);
+
+    g_logger.syslog.sizes[index] = count + size;
+    g_logger.syslog.count += 1;
+}
+/*--------------------------------------------------------------------------*/
 /* Log writer entry point */
 /*--------------------------------------------------------------------------*/
-static void log_write(const char * message, size_t size)
+static void log_write(long level, const char * message, size_t size)
 {
     if (g_logger.conf.log_to_console)
         fprintf(get_log_stream(), "%s\n", message);
 
-    if (g_logger.conf.log_to_file)
-        log_file_write(message, size);
+    if (g_logger.conf.log_to_file) {
+        if (g_logger.ring.buffer != NULL)
+            log_ring_write(message, size);
+        else
+            log_file_write(message, size);
+    }
+
+    if (g_logger.conf.log_to_syslog)
+        log_syslog_write(level, message, size);
 }
 /*--------------------------------------------------------------------------*/
 /* Interface functions */
@@ -207,7 +441,7 @@ void chandler_get_time(long * sec, int * msec)
     *msec = (int)(ts.tv_nsec / 1000000);
 }
 /*--------------------------------------------------------------------------*/
-void chandler_log(const char * format, ...)
+void chandler_log(long level, const char * format, ...)
 {
     char     buffer[LOG_MESSAGE_BUFFER_SIZE];
     va_list  v_args;
@@ -221,7 +455,67 @@ void chandler_log(const char * format, ...)
     buffer[size] = '\0';
 
     if (size > 0) {
-        log_write(buffer, size);
+        log_write(level, buffer, size);
+    }
+}
+/*--------------------------------------------------------------------------*/
+void chandler_log_flush(void)
+{
+    struct mmsghdr msgs[SYSLOG_QUEUE_SIZE];
+    struct iovec   iovs[SYSLOG_QUEUE_SIZE];
+    size_t         index;
+    size_t         i;
+    int            sent;
+
+    if (g_logger.syslog.count == 0)
+        return;
+
+    if (log_syslog_open() != 0) {
+        log_syslog_drop(g_logger.syslog.count);
+        return;
+    }
+
+    memset(msgs, 0, sizeof(msgs[0]) * g_logger.syslog.count);
+
+    for (i = 0; i < g_logger.syslog.count; ++i) {
+        index = (g_logger.syslog.head + i) % SYSLOG_QUEUE_SIZE;
+        iovs[i].iov_base = g_logger.syslog.records[index];
+        iovs[i].iov_len  = g_logger.syslog.sizes[index];
+        msgs[i].msg_hdr.msg_iov    = &iovs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    sent = sendmmsg(g_logger.syslog.fd, msgs, g_logger.syslog.count, MSG_DONTWAIT);
+    if (sent > 0) {
+        g_logger.stat.syslog_sent += sent;
+        g_logger.syslog.head   = (g_logger.syslog.head + sent) % SYSLOG_QUEUE_SIZE;
+        g_logger.syslog.count -= sent;
+        return;
+    }
+
+    switch (errno)
+    {
+    case EAGAIN:
+    case ENOBUFS:
+    case EINTR:
+        /* socket is full - keep records queued until the next flush */
+        break;
+    case ECONNREFUSED:
+    case ENOTCONN:
+    case ENOENT:
+        /* syslog daemon has gone - reconnect on the next flush */
+        log_syslog_close();
+        log_syslog_drop(g_logger.syslog.count);
+        break;
+    default:
+        log_syslog_drop(g_logger.syslog.count);
+    }
+}
+/*--------------------------------------------------------------------------*/
+void chandler_log_incident(void)
+{
+    if (g_logger.ring.buffer != NULL) {
+        log_ring_flush();
     }
 }
 /*--------------------------------------------------------------------------*/
@@ -238,6 +532,19 @@ int chandler_log_init(void)
             fprintf(stderr, "Failed to open log file: %d (%s)\n", errno, strerror(errno));
             return 0;
         }
+
+        if (g_logger.conf.ring_size) {
+            g_logger.ring.buffer = malloc(g_logger.conf.ring_size);
+            if (NULL == g_logger.ring.buffer) {
+                fprintf(stderr, "Failed to allocate log ring of %ld bytes\n", g_logger.conf.ring_size);
+                return 0;
+            }
+            g_logger.ring.size = g_logger.conf.ring_size;
+        }
+    }
+
+    if (g_logger.conf.log_to_syslog) {
+        log_syslog_open();
     }
 
     return 1;
@@ -247,6 +554,13 @@ void chandler_log_done(void)
 {
     if (g_logger.conf.log_to_file) {
         log_file_close();
+        free(g_logger.ring.buffer);
+        g_logger.ring.buffer = NULL;
+    }
+
+    if (g_logger.conf.log_to_syslog) {
+        chandler_log_flush();
+        log_syslog_close();
     }
 }
 /*--------------------------------------------------------------------------*/
@@ -254,3 +568,8 @@ chandler_log_conf_t * chandler_log_conf(void)
 {
     return &g_logger.conf;
 }
+/*--------------------------------------------------------------------------*/
+chandler_log_stat_t * chandler_log_stat(void)
+{
+    return &g_logger.stat;
+}
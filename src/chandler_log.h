@@ -64,7 +64,8 @@
             char str__[CHANDLER_LOG_MESSAGE_SIZE] = {0};      \
             chandler_get_time(&sec__, &msec__);               \
             snprintf(str__, sizeof(str__), __VA_ARGS__); \
-            chandler_log(CHANDLER_LOG_FORMAT(LEVEL__),             \
+            chandler_log(LEVEL__##_ID,                        \
+                CHANDLER_LOG_FORMAT(LEVEL__),            \
                 sec__,                                   \
                 msec__,                                  \
                 str__                                    \
@@ -87,16 +88,33 @@
 #define MAX_LOG_FILE_PATH_SIZE      (PATH_MAX - LOG_ROTATION_SUFFIX_LENGTH)
 #define MAX_LOG_FILE_SIZE           INT32_MAX
 #define MIN_LOG_FILE_SIZE           4096
+#define MAX_LOG_RING_SIZE           (16 * 1024 * 1024)
+#define MIN_LOG_RING_SIZE           4096
 
 typedef struct chandler_log_conf_t
 {
     char file_name[MAX_LOG_FILE_PATH_SIZE];
     int  log_to_console;
     int  log_to_file;
+    int  log_to_syslog;
     long file_size_limit;
     long rotate_file_count;
+    long ring_size;          // size of in-memory ring used instead of direct file output (0 - disabled)
 } chandler_log_conf_t;
 
+/*
+ * Definitions for syslog output support
+ */
+#define SYSLOG_SOCKET_PATH          "/dev/log"
+#define SYSLOG_QUEUE_SIZE           32
+#define SYSLOG_RECORD_SIZE          1024
+
+typedef struct chandler_log_stat_t
+{
+    long syslog_sent;        // number of records delivered to the syslog socket
+    long syslog_dropped;     // number of records dropped because the socket was full or unavailable
+} chandler_log_stat_t;
+
 /**
  * Sets the global logging level.
  *
@@ -125,10 +143,30 @@ void chandler_get_time(long * sec, int * msec);
 /**
  * Writes formatted message to log.
  *
+ * \param level   Level identifier of the message (CHANDLER_LOG_LEVEL_XXX_ID).
  * \param format  Message printf-like format.
  * \param ...     Optional format arguments.
  */
-void chandler_log(const char * format, ...);
+void chandler_log(long level, const char * format, ...);
+
+/**
+ * Sends records queued for the syslog socket with a single sendmmsg() call.
+ *
+ * Function never blocks: records which do not fit into the socket are kept
+ * queued until the next call, and new records are dropped (and counted) while
+ * the queue is full.
+ */
+void chandler_log_flush(void);
+
+/**
+ * Writes all records accumulated in the in-memory ring to the log file.
+ *
+ * When the ring is enabled, file output is deferred until something goes
+ * wrong: function should be called on every incident (daemon restart or
+ * kill, controller disconnect, reboot decision) to save its context.
+ * Does nothing if the ring is disabled.
+ */
+void chandler_log_incident(void);
 
 /**
  * Initializes a logger.
@@ -152,4 +190,11 @@ void chandler_log_done(void);
  */
 chandler_log_conf_t * chandler_log_conf(void);
 
+/**
+ * Returns pointer to log output statistics
+ *
+ * \return
+ */
+chandler_log_stat_t * chandler_log_stat(void);
+
 #endif  /* CHANDLER_LOG_H */
@@ -0,0 +1,259 @@
+/*
+################################################################################
+#
+#  Copyright 2020-2021 Inango Systems Ltd.
+#
+#  Licensed under the Apache License, Version 2.0 (the "License");
+#  you may not use this file except in compliance with the License.
+#  You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+#  Unless required by applicable law or agreed to in writing, software
+#  distributed under the License is distributed on an "AS IS" BASIS,
+#  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+#  See the License for the specific language governing permissions and
+#  limitations under the License.
+#
+################################################################################
+*/
+#define _GNU_SOURCE
+
+#include "chandler_loop.h"
+
+#include "chandler_log.h"
+
+#include <errno.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+
+
+typedef struct loop_slot_t {
+    int                fd;             // -1 - slot is free or released during current dispatch
+    int                in_use;         // slot can't be reused until the current dispatch ends
+    loop_fd_handler_t  handler;
+    void              *ctx;
+} loop_slot_t;
+
+typedef struct loop_signal_t {
+    loop_signal_handler_t  handler;
+    void                  *ctx;
+} loop_signal_t;
+
+typedef struct event_loop_t {
+    int            epoll_fd;
+    int            signal_fd;
+    int            is_stopped;
+    int            is_dispatching;
+    sigset_t       signals;
+    loop_slot_t    slots[MAX_LOOP_FDS];
+    loop_signal_t  signal_handlers[NSIG];
+} event_loop_t;
+
+
+static event_loop_t g_loop = {.epoll_fd = -1, .signal_fd = -1};
+
+
+static loop_slot_t * find_slot(int fd)
+{
+    for (int i = 0; i < MAX_LOOP_FDS; ++i) {
+        if (g_loop.slots[i].fd == fd && g_loop.slots[i].in_use) {
+            return &g_loop.slots[i];
+        }
+    }
+
+    return NULL;
+}
+
+static void on_signal_fd(int fd, uint32_t events, void * ctx)
+{
+    struct signalfd_siginfo info;
+
+    (void)events;
+    (void)ctx;
+
+    while (sizeof(info) == read(fd, &info, sizeof(info))) {
+        if (info.ssi_signo < NSIG && g_loop.signal_handlers[info.ssi_signo].handler != NULL) {
+            g_loop.signal_handlers[info.ssi_signo].handler(&info, g_loop.signal_handlers[info.ssi_signo].ctx);
+        }
+    }
+}
+
+int loop_init(void)
+{
+    for (int i = 0; i < MAX_LOOP_FDS; ++i) {
+        g_loop.slots[i].fd     = -1;
+        g_loop.slots[i].in_use = 0;
+    }
+
+    g_loop.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (g_loop.epoll_fd == -1) {
+        LOG_ERROR("failed to create epoll descriptor: %d (%s)", errno, strerror(errno));
+        return errno;
+    }
+
+    sigemptyset(&g_loop.signals);
+
+    g_loop.signal_fd = signalfd(-1, &g_loop.signals, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (g_loop.signal_fd == -1) {
+        LOG_ERROR("failed to create signalfd: %d (%s)", errno, strerror(errno));
+        return errno;
+    }
+
+    return loop_add_fd(g_loop.signal_fd, EPOLLIN, on_signal_fd, NULL);
+}
+
+void loop_done(void)
+{
+    if (g_loop.signal_fd != -1) {
+        close(g_loop.signal_fd);
+        g_loop.signal_fd = -1;
+    }
+
+    if (g_loop.epoll_fd != -1) {
+        close(g_loop.epoll_fd);
+        g_loop.epoll_fd = -1;
+    }
+}
+
+int loop_add_fd(int fd, uint32_t events, loop_fd_handler_t handler, void * ctx)
+{
+    struct epoll_event  event;
+    loop_slot_t        *slot = NULL;
+
+    for (int i = 0; i < MAX_LOOP_FDS; ++i) {
+        if (!g_loop.slots[i].in_use) {
+            slot = &g_loop.slots[i];
+            break;
+        }
+    }
+
+    if (slot == NULL) {
+        LOG_ERROR("no free slot in event loop for descriptor %d", fd);
+        return ENOSPC;
+    }
+
+    event.events   = events;
+    event.data.ptr = slot;
+
+    if (epoll_ctl(g_loop.epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0) {
+        LOG_ERROR("failed to add descriptor %d to epoll: %d (%s)", fd, errno, strerror(errno));
+        return errno;
+    }
+
+    slot->fd      = fd;
+    slot->in_use  = 1;
+    slot->handler = handler;
+    slot->ctx     = ctx;
+
+    return 0;
+}
+
+int loop_mod_fd(int fd, uint32_t events)
+{
+    struct epoll_event  event;
+    loop_slot_t        *slot = find_slot(fd);
+
+    if (slot == NULL) {
+        return ENOENT;
+    }
+
+    event.events   = events;
+    event.data.ptr = slot;
+
+    if (epoll_ctl(g_loop.epoll_fd, EPOLL_CTL_MOD, fd, &event) != 0) {
+        LOG_ERROR("failed to modify descriptor %d in epoll: %d (%s)", fd, errno, strerror(errno));
+        return errno;
+    }
+
+    return 0;
+}
+
+void loop_del_fd(int fd)
+{
+    loop_slot_t *slot = find_slot(fd);
+
+    if (slot == NULL) {
+        return;
+    }
+
+    epoll_ctl(g_loop.epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+
+    /* events of the current batch may still refer to the slot */
+    slot->fd = -1;
+    if (!g_loop.is_dispatching) {
+        slot->in_use = 0;
+    }
+}
+
+int loop_add_signal(int signo, loop_signal_handler_t handler, void * ctx)
+{
+    sigset_t mask;
+
+    if (signo <= 0 || signo >= NSIG) {
+        return EINVAL;
+    }
+
+    sigemptyset(&mask);
+    sigaddset(&mask, signo);
+    if (sigprocmask(SIG_BLOCK, &mask, NULL) != 0) {
+        return errno;
+    }
+
+    sigaddset(&g_loop.signals, signo);
+    if (signalfd(g_loop.signal_fd, &g_loop.signals, 0) == -1) {
+        LOG_ERROR("failed to update signalfd: %d (%s)", errno, strerror(errno));
+        return errno;
+    }
+
+    g_loop.signal_handlers[signo].handler = handler;
+    g_loop.signal_handlers[signo].ctx     = ctx;
+
+    return 0;
+}
+
+int loop_run_once(int timeout_msec)
+{
+    struct epoll_event  events[MAX_LOOP_EVENTS];
+    loop_slot_t        *slot;
+    int                 count;
+
+    count = epoll_wait(g_loop.epoll_fd, events, MAX_LOOP_EVENTS, timeout_msec);
+    if (count < 0) {
+        if (errno != EINTR) {
+            LOG_ERROR("epoll_wait failed: %d (%s)", errno, strerror(errno));
+        }
+        return -1;
+    }
+
+    g_loop.is_dispatching = 1;
+
+    for (int i = 0; i < count; ++i) {
+        slot = events[i].data.ptr;
+        if (slot->fd != -1) {
+            slot->handler(slot->fd, events[i].events, slot->ctx);
+        }
+    }
+
+    g_loop.is_dispatching = 0;
+
+    /* release slots unregistered during the dispatch */
+    for (int i = 0; i < MAX_LOOP_FDS; ++i) {
+        if (g_loop.slots[i].fd == -1) {
+            g_loop.slots[i].in_use = 0;
+        }
+    }
+
+    return count;
+}
+
+void loop_stop(void)
+{
+    g_loop.is_stopped = 1;
+}
+
+int loop_is_stopped(void)
+{
+    return g_loop.is_stopped;
+}
@@ -0,0 +1,104 @@
+/*
+################################################################################
+#
+#  Copyright 2020-2021 Inango Systems Ltd.
+#
+#  Licensed under the Apache License, Version 2.0 (the "License");
+#  you may not use this file except in compliance with the License.
+#  You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+#  Unless required by applicable law or agreed to in writing, software
+#  distributed under the License is distributed on an "AS IS" BASIS,
+#  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+#  See the License for the specific language governing permissions and
+#  limitations under the License.
+#
+################################################################################
+*/
+#ifndef CHANDLER_LOOP_H
+#define CHANDLER_LOOP_H
+
+#include <stdint.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+
+#define MAX_LOOP_FDS          64
+#define MAX_LOOP_EVENTS       16
+
+/* Called when registered descriptor is ready, events - EPOLLXXX bit mask */
+typedef void (* loop_fd_handler_t)(int fd, uint32_t events, void * ctx);
+
+/* Called synchronously from the loop when registered signal is received */
+typedef void (* loop_signal_handler_t)(const struct signalfd_siginfo * info, void * ctx);
+
+/**
+ * Initializes the event loop: creates epoll and signalfd descriptors.
+ * Timers are provided on top of it by the timer wheel (chandler_timer.h).
+ *
+ * \return  0 on success, errno value - otherwise
+ */
+int  loop_init(void);
+
+/**
+ * Closes all descriptors owned by the loop.
+ */
+void loop_done(void);
+
+/**
+ * Registers a descriptor. Handler is called with the ready events only.
+ *
+ * \param fd       Descriptor to watch
+ * \param events   EPOLLIN, EPOLLOUT etc.
+ * \param handler  Handler to call when descriptor is ready
+ * \param ctx      Context passed to the handler
+ *
+ * \return         0 on success, errno value - otherwise
+ */
+int  loop_add_fd(int fd, uint32_t events, loop_fd_handler_t handler, void * ctx);
+
+/**
+ * Changes the set of watched events of a registered descriptor.
+ *
+ * \return  0 on success, errno value - otherwise
+ */
+int  loop_mod_fd(int fd, uint32_t events);
+
+/**
+ * Unregisters a descriptor. It is safe to call from any handler, including
+ * the handler of the descriptor itself. The descriptor is not closed.
+ */
+void loop_del_fd(int fd);
+
+/**
+ * Blocks the signal and delivers it through signalfd to the handler.
+ *
+ * Blocked signals survive exec(), so spawned processes should reset the
+ * signal mask.
+ *
+ * \return  0 on success, errno value - otherwise
+ */
+int  loop_add_signal(int signo, loop_signal_handler_t handler, void * ctx);
+
+/**
+ * Waits for events and dispatches them to handlers. Cost of the dispatch is
+ * proportional to the number of ready descriptors only.
+ *
+ * \param timeout_msec  Maximal time to wait (-1 - infinitely)
+ *
+ * \return              Number of dispatched events or -1 on error
+ */
+int  loop_run_once(int timeout_msec);
+
+/**
+ * Makes loop_is_stopped() return 1.
+ */
+void loop_stop(void);
+
+/**
+ * Returns 1 if loop_stop() has been called.
+ */
+int  loop_is_stopped(void);
+
+#endif  /* CHANDLER_LOOP_H */
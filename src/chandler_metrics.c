@@ -0,0 +1,171 @@
+/*
+################################################################################
+#
+#  Copyright 2020-2021 Inango Systems Ltd.
+#
+#  Licensed under the Apache License, Version 2.0 (the "License");
+#  you may not use this file except in compliance with the License.
+#  You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+#  Unless required by applicable law or agreed to in writing, software
+#  distributed under the License is distributed on an "AS IS" BASIS,
+#  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+#  See the License for the specific language governing permissions and
+#  limitations under the License.
+#
+################################################################################
+*/
+#include "chandler_metrics.h"
+
+#include "chandler_log.h"
+#include "chandler_stat.h"
+
+#include <string.h>
+
+
+static metric_t g_metrics[MAX_METRICS];
+static size_t   g_metrics_count = 0;
+
+/* Returned when the registry is full */
+static metric_t g_metric_placeholder;
+
+
+static void copy_string(char * target, size_t size, const char * source)
+{
+    strncpy(target, source, size - 1);
+    target[size - 1] = '\0';
+}
+
+static size_t histogram_bucket_index(uint64_t value)
+{
+    size_t index;
+
+    if (value <= 1) {
+        return 0;
+    }
+
+    /* ceil(log2(value)) */
+    index = 64 - __builtin_clzll(value - 1);
+
+    return index < METRIC_HISTOGRAM_BUCKETS? index: METRIC_HISTOGRAM_BUCKETS;
+}
+
+void metrics_init(void)
+{
+    metric_register_external(MT_COUNTER, "chandler_restarts_total", "Number of daemon relaunches", &chandler_stat()->restarts_count);
+    metric_register_external(MT_COUNTER, "chandler_kills_total", "Number of killed daemons", &chandler_stat()->kills_count);
+    metric_register_external(MT_COUNTER, "chandler_failures_total", "Number of failed recovery actions", &chandler_stat()->failures_count);
+    metric_register_external(MT_COUNTER, "chandler_reboots_total", "Number of reboots requested by chandler", &chandler_stat()->reboots_count);
+    metric_register_external(MT_COUNTER, "chandler_boots_total", "Number of system boots", &chandler_stat()->boots_count);
+    metric_register_external(MT_COUNTER, "chandler_syslog_sent_total", "Number of records sent to syslog", &chandler_log_stat()->syslog_sent);
+    metric_register_external(MT_COUNTER, "chandler_syslog_dropped_total", "Number of records dropped by syslog output", &chandler_log_stat()->syslog_dropped);
+}
+
+metric_t * metric_register(metric_type_t type, const char * name, const char * help, const char * label_name, const char * label_value)
+{
+    metric_t *metric;
+
+    if (label_name == NULL) {
+        label_value = "";
+    }
+
+    for (size_t i = 0; i < g_metrics_count; ++i) {
+        metric = &g_metrics[i];
+        if (0 == strcmp(metric->name, name) && 0 == strcmp(metric->label_value, label_value)) {
+            return metric;
+        }
+    }
+
+    if (g_metrics_count == MAX_METRICS) {
+        LOG_ERROR("metrics registry is full - metric \"%s\" is not exported", name);
+        return &g_metric_placeholder;
+    }
+
+    metric = &g_metrics[g_metrics_count++];
+    memset(metric, 0, sizeof(*metric));
+
+    metric->type       = type;
+    metric->help       = help;
+    metric->label_name = label_name;
+    copy_string(metric->name, sizeof(metric->name), name);
+    copy_string(metric->label_value, sizeof(metric->label_value), label_value);
+
+    return metric;
+}
+
+metric_t * metric_register_external(metric_type_t type, const char * name, const char * help, long * value)
+{
+    metric_t *metric = metric_register(type, name, help, NULL, NULL);
+
+    metric->external = value;
+    return metric;
+}
+
+void metric_add(metric_t * metric, long value)
+{
+    if (metric->external != NULL) {
+        *metric->external += value;
+    }
+    else {
+        metric->value += value;
+    }
+}
+
+void metric_set(metric_t * metric, long value)
+{
+    if (metric->external != NULL) {
+        *metric->external = value;
+    }
+    else {
+        metric->value = value;
+    }
+}
+
+void metric_observe(metric_t * metric, uint64_t value)
+{
+    metric->histogram.buckets[histogram_bucket_index(value)] += 1;
+    metric->histogram.count += 1;
+    metric->histogram.sum   += value;
+}
+
+long metric_value(const metric_t * metric)
+{
+    return metric->external != NULL? *metric->external: metric->value;
+}
+
+uint64_t metric_bucket_bound(size_t index)
+{
+    return (uint64_t)1 << index;
+}
+
+void metrics_reset(void)
+{
+    for (size_t i = 0; i < g_metrics_count; ++i) {
+        switch (g_metrics[i].type)
+        {
+        case MT_COUNTER:
+            /* external counters are owned by their modules, e.g. the ones in the state file feed the reboot policy */
+            if (g_metrics[i].external == NULL) {
+                g_metrics[i].value = 0;
+            }
+            break;
+        case MT_HISTOGRAM:
+            memset(&g_metrics[i].histogram, 0, sizeof(g_metrics[i].histogram));
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+size_t metrics_count(void)
+{
+    return g_metrics_count;
+}
+
+metric_t * metric_at(size_t index)
+{
+    return &g_metrics[index];
+}
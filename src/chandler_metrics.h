@@ -0,0 +1,120 @@
+/*
+################################################################################
+#
+#  Copyright 2020-2021 Inango Systems Ltd.
+#
+#  Licensed under the Apache License, Version 2.0 (the "License");
+#  you may not use this file except in compliance with the License.
+#  You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+#  Unless required by applicable law or agreed to in writing, software
+#  distributed under the License is distributed on an "AS IS" BASIS,
+#  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+#  See the License for the specific language governing permissions and
+#  limitations under the License.
+#
+################################################################################
+*/
+#ifndef CHANDLER_METRICS_H
+#define CHANDLER_METRICS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define MAX_METRICS                 192
+#define MAX_METRIC_NAME_SIZE        64
+#define MAX_METRIC_LABEL_SIZE       64
+
+/* Histogram bucket i counts values <= 2^i, the last bucket counts all the rest */
+#define METRIC_HISTOGRAM_BUCKETS    32
+
+
+typedef enum metric_type_t {
+    MT_COUNTER,
+    MT_GAUGE,
+    MT_HISTOGRAM
+} metric_type_t;
+
+typedef struct metric_histogram_t {
+    uint64_t buckets[METRIC_HISTOGRAM_BUCKETS + 1];  // non-cumulative counts per bucket
+    uint64_t count;                                  // total number of observations
+    uint64_t sum;                                    // sum of all observed values
+} metric_histogram_t;
+
+typedef struct metric_t {
+    metric_type_t       type;
+    char                name[MAX_METRIC_NAME_SIZE];
+    const char         *help;
+    const char         *label_name;                  // name of the only label (NULL if metric has no label)
+    char                label_value[MAX_METRIC_LABEL_SIZE];
+    long               *external;                    // value owned by another module (NULL if not used)
+    long                value;                       // counter or gauge value
+    metric_histogram_t  histogram;
+} metric_t;
+
+
+/**
+ * Registers metrics for values owned by other modules (chandler_stat_t
+ * counters, logger statistics).
+ *
+ * Function should be called once in the main process before metrics are
+ * exported.
+ */
+void       metrics_init(void);
+
+/**
+ * Looks up the metric by name and label value or registers a new one.
+ *
+ * Registry has a fixed size: when it is full, the returned metric is a valid
+ * placeholder which is never exported, so that callers don't need to check
+ * the result.
+ *
+ * \param type         Type of the metric
+ * \param name         Metric name, e.g. "chandler_probe_rtt_usec"
+ * \param help         Static description of the metric
+ * \param label_name   Static name of the only label or NULL
+ * \param label_value  Value of the label (ignored if label_name is NULL)
+ *
+ * \return             Pointer to the metric
+ */
+metric_t * metric_register(metric_type_t type, const char * name, const char * help, const char * label_name, const char * label_value);
+
+/**
+ * Registers a metric which value is stored outside of the registry.
+ *
+ * \param type   MT_COUNTER or MT_GAUGE
+ * \param name   Metric name
+ * \param help   Static description of the metric
+ * \param value  Pointer to the value
+ *
+ * \return       Pointer to the metric
+ */
+metric_t * metric_register_external(metric_type_t type, const char * name, const char * help, long * value);
+
+/* Increments a counter or a gauge */
+void       metric_add(metric_t * metric, long value);
+
+/* Sets a gauge */
+void       metric_set(metric_t * metric, long value);
+
+/* Adds an observation to a histogram */
+void       metric_observe(metric_t * metric, uint64_t value);
+
+/* Returns the current value of a counter or a gauge */
+long       metric_value(const metric_t * metric);
+
+/* Returns the upper bound of histogram bucket with given index */
+uint64_t   metric_bucket_bound(size_t index);
+
+/* Resets counters and histograms owned by the registry, gauges and external counters are kept */
+void       metrics_reset(void);
+
+/* Returns number of registered metrics */
+size_t     metrics_count(void);
+
+/* Returns registered metric by index (0 <= index < metrics_count()) */
+metric_t * metric_at(size_t index);
+
+#endif  /* CHANDLER_METRICS_H */
@@ -19,57 +19,207 @@
 */
 #define _POSIX_SOURCE
 
+#include "chandler_cgroup.h"
 #include "chandler_conf.h"
+#include "chandler_escalation.h"
+#include "chandler_event.h"
 #include "chandler_jrpc.h"
 #include "chandler_log.h"
+#include "chandler_loop.h"
+#include "chandler_metrics.h"
 #include "chandler_ovs.h"
+#include "chandler_policy.h"
+#include "chandler_proc.h"
+#include "chandler_rtt.h"
+#include "chandler_spawner.h"
 #include "chandler_stat.h"
 #include "chandler_system.h"
+#include "chandler_timer.h"
 
 #include <errno.h>
 #include <stddef.h>
+#include <stdio.h>
 #include <string.h>
 #include <sys/socket.h>
-#include <sys/time.h>
 #include <sys/types.h>
+#include <sys/wait.h>
 #include <unistd.h>
 #include <signal.h>
 
 
+#define MAX_OUTPUT_LINE_SIZE  1024
+#define THROTTLE_REPORT_MSEC  1000
+#define MAX_THREAD_GROUPS     8
+#define MAX_THREADS_DETAIL_SIZE 128
+
+
 typedef enum daemon_status_t {
     DS_ALIVE,
     DS_NO_RESPONSE,
     DS_NOT_ALIVE,
     DS_NO_PROCESS,
+    DS_STUCK,
     DS_SYSTEM_ERROR
 } daemon_status_t;
 
+/* Threads with names starting with the prefix, saturated or stuck ones are counted by the metric */
+typedef struct thread_group_t {
+    char             prefix[PROC_COMM_SIZE];
+    metric_t        *metric;
+} thread_group_t;
+
+typedef struct thread_groups_t {
+    thread_group_t   groups[MAX_THREAD_GROUPS];
+    size_t           count;
+} thread_groups_t;
+
+typedef struct ovs_daemon_t {
+    daemon_status_t  status;       // result of the last check
+    pid_t            pid;          // pid found by the last check
+    uint64_t         check_time;   // time of the last check in usec (0 - never checked)
+    uint64_t         rtt;          // round trip time of the last successful probe in usec
+    uint64_t         spawn_time;   // time of the last spawn in usec (0 - daemon is not starting)
+    int              is_waiting;   // spawn is postponed until dependencies are ready
+    pid_t            stop_pid;     // process being stopped (0 - none)
+    int              stop_fd;      // pidfd of the process being stopped (-1 - none)
+    int              stop_signal;  // the last signal sent to the process being stopped
+    pid_t            child_pid;    // pid of the daemon run as a child of chandler (0 - none)
+    int              output_fd;    // pipe connected to stdout and stderr of the child (-1 - none)
+    size_t           output_size;  // number of bytes of an incomplete line in output
+    char             output[MAX_OUTPUT_LINE_SIZE];
+    spawn_policy_t   policy;       // scheduling and resource policy applied to spawned processes
+    cgroup_t         cgroup;       // cgroup the daemon is placed into (cgroup_root is set)
+    uint64_t         throttle_time;  // time of the latest throttling report in usec
+    long             throttles;    // number of throttling events not reported yet
+    metric_t        *oom_kills;
+    metric_t        *memory_high;
+    proc_files_t     proc;         // /proc files of the process found by the last check
+    proc_sample_t    sample;       // the latest resource usage sample
+    uint64_t         pss_baseline; // PSS (or RSS) in kB of the first sample of the process
+    int              is_restart_planned;  // memory growth has exceeded pss_growth, restart waits for maintenance_window
+    int              is_planned_stop;     // stopped for the planned restart, its relaunch does not count toward restarts_before_reboot
+    metric_t        *rss;
+    metric_t        *pss;
+    metric_t        *cpu_time;
+    metric_t        *threads;
+    metric_t        *fds;
+    proc_threads_t   proc_threads; // threads of the process checked for busy loops and being stuck
+    thread_groups_t  busy_groups;  // parsed busy_threads
+    thread_groups_t  stuck_groups; // parsed stuck_threads
+    int              busy_action;  // escalation_action_t taken on a busy loop (-1 - none)
+    int              is_busy;      // saturation of threads has been reported
+    char             busy_detail[MAX_THREADS_DETAIL_SIZE];   // saturated threads with their CPU usage
+    long             stuck_count;  // number of stuck threads found by the latest sample
+    char             stuck_detail[MAX_THREADS_DETAIL_SIZE];  // stuck threads with their state and wait channel
+    uint64_t         restart_time; // time of the last spawn in usec, kept after the daemon is ready
+    long             backoff;      // delay in msec between the last spawn and the next one
+    escalation_state_t escalation; // step of the escalation ladder taken for the latest failure
+    metric_t        *probe_rtt;
+    metric_t        *connect_time;
+    metric_t        *reply_size;
+    metric_t        *spawn_to_ready;
+    metric_t        *probe_deadline;
+    metric_t        *rtt_ewma;
+    metric_t        *restart_backoff;
+    rtt_window_t     rtts;         // RTTs of the latest successful probes
+    long             misses;       // number of consecutive missed probe deadlines
+    char             name[MAX_APP_NAME_SIZE];  // name of the service, metrics are labeled with it
+    const service_conf_t *conf;    // configuration of the service (points into get_conf())
+    const char      *target;       // ctl socket of the service, name if not configured
+    const char      *pidfile;
+    const char      *cmd;
+    size_t           deps[MAX_SERVICES];  // indexes of services this one depends on
+    size_t           deps_count;
+    int              probe_fd;     // connection of the probe in progress (-1 - none)
+    long             retries_left; // number of probes left before blaming the daemon
+    uint64_t         send_time;    // time when the probe request was sent in usec
+    wheel_timer_t    deadline;     // receive deadline of the probe or delay before the next retry
+    size_t           response_size;
+    char             response[MAX_RESPONSE_SIZE];
+} ovs_daemon_t;
+
+
+/* Runtime state of services, an entry matches get_conf()->services entry with the same index */
+static ovs_daemon_t   g_daemons[MAX_SERVICES];
+static long           g_daemons_count = 0;
+static size_t         g_order[MAX_SERVICES];          // indexes of services in dependency order
+static service_conf_t g_services[MAX_SERVICES];       // copy of the service table g_daemons are bound to
+static char           g_cgroup_root[MAX_PATH_SIZE];   // cgroup_root the services are placed into
+static long           g_planned_restarts = 0;         // relaunches after planned restarts, see is_planned_stop
+static int            g_is_restarting_all = 0;        // services are spawned when the last of them has stopped
+
+static const ovs_handlers_t *g_handlers = NULL;
+
+
+
+static void ovs_daemon_init(ovs_daemon_t * daemon, const char * target)
+{
+    daemon->probe_rtt      = metric_register(MT_HISTOGRAM, "chandler_probe_rtt_usec", "Time from sending a probe request to receiving the response", "daemon", target);
+    daemon->connect_time   = metric_register(MT_HISTOGRAM, "chandler_probe_connect_usec", "Time to connect to the daemon control socket", "daemon", target);
+    daemon->reply_size     = metric_register(MT_HISTOGRAM, "chandler_probe_reply_bytes", "Size of the probe response", "daemon", target);
+    daemon->spawn_to_ready = metric_register(MT_HISTOGRAM, "chandler_spawn_to_ready_usec", "Time from spawning the daemon to its first successful probe", "daemon", target);
+    daemon->probe_deadline = metric_register(MT_GAUGE, "chandler_probe_deadline_msec", "Receive deadline of the latest probe", "daemon", target);
+    daemon->restart_backoff = metric_register(MT_GAUGE, "chandler_restart_backoff_msec", "Delay between the latest relaunches of a daemon", "daemon", target);
+    daemon->rtt_ewma       = metric_register(MT_GAUGE, "chandler_probe_rtt_ewma_usec", "Exponentially weighted moving average of probe RTT", "daemon", target);
+    daemon->oom_kills      = metric_register(MT_COUNTER, "chandler_cgroup_oom_kills_total", "Number of processes killed by OOM killer in the daemon cgroup", "daemon", target);
+    daemon->memory_high    = metric_register(MT_COUNTER, "chandler_cgroup_memory_high_total", "Number of times the daemon cgroup has been throttled over memory.high or hit memory.max", "daemon", target);
+    daemon->rss            = metric_register(MT_GAUGE, "chandler_process_rss_kbytes", "Resident set size of the daemon process", "daemon", target);
+    daemon->pss            = metric_register(MT_GAUGE, "chandler_process_pss_kbytes", "Proportional set size of the daemon process", "daemon", target);
+    daemon->cpu_time       = metric_register(MT_GAUGE, "chandler_process_cpu_msec", "User and system CPU time consumed by the daemon process", "daemon", target);
+    daemon->threads        = metric_register(MT_GAUGE, "chandler_process_threads", "Number of threads of the daemon process", "daemon", target);
+    daemon->fds            = metric_register(MT_GAUGE, "chandler_process_fds", "Number of file descriptors open by the daemon process", "daemon", target);
+}
+
+static const char * ovs_status_name(daemon_status_t status)
+{
+    switch (status)
+    {
+    case DS_ALIVE:
+        return "alive";
+    case DS_NO_RESPONSE:
+        return "not responding";
+    case DS_NOT_ALIVE:
+        return "not alive";
+    case DS_NO_PROCESS:
+        return "no process";
+    case DS_STUCK:
+        return "threads stuck";
+    default:
+        return "system error";
+    }
+}
 
 static const char * ovs_rundir(void)
 {
     return get_conf()->ovs_run_dir;
 }
 
-static pid_t ovs_get_pid(const char * target, const char * pidfile)
+static char * ovs_make_pidfile_name(char * buffer, size_t buffer_size, const char * target, const char * pidfile)
 {
-    char  pid_file_name[MAX_PATH_SIZE];
-    int   count;
-
-    if (pidfile && pidfile[0] != '\0') {
-        if (pidfile[0] == '/') {
-            return read_pid_from_file(pidfile);
-        }
+    int count;
 
-        count = snprintf(pid_file_name, sizeof(pid_file_name), "%s/%s", ovs_rundir(), pidfile);
-        if (count < 0 || (size_t)count >= sizeof(pid_file_name)) {
-            return -1;
-        }
+    if (pidfile && pidfile[0] == '/') {
+        count = snprintf(buffer, buffer_size, "%s", pidfile);
+    }
+    else if (pidfile && pidfile[0] != '\0') {
+        count = snprintf(buffer, buffer_size, "%s/%s", ovs_rundir(), pidfile);
+    }
+    else {
+        count = snprintf(buffer, buffer_size, "%s/%s.pid", ovs_rundir(), target);
+    }
 
-        return read_pid_from_file(pid_file_name);
+    if (count < 0 || (size_t)count >= buffer_size) {
+        return NULL;
     }
 
-    count = snprintf(pid_file_name, sizeof(pid_file_name), "%s/%s.pid", ovs_rundir(), target);
-    if (count < 0 || (size_t)count >= sizeof(pid_file_name)) {
+    return buffer;
+}
+
+static pid_t ovs_get_pid(const char * target, const char * pidfile)
+{
+    char pid_file_name[MAX_PATH_SIZE];
+
+    if (NULL == ovs_make_pidfile_name(pid_file_name, sizeof(pid_file_name), target, pidfile)) {
         return -1;
     }
 
@@ -102,29 +252,175 @@ static char * ovs_make_unix_socket_name(char * buffer, size_t buffer_size, const
     return buffer;
 }
 
-query_status_t ovs_query_daemon(const char * target, pid_t pid)
+static void ovs_handle_status(ovs_daemon_t * daemon, daemon_status_t status);
+static void ovs_check_daemon(ovs_daemon_t * daemon);
+
+void ovs_get_daemon_status(ovs_daemon_t * daemon);
+
+static daemon_status_t ovs_probe_status(ovs_daemon_t * daemon, query_status_t qs)
+{
+    if (qs == QS_SUCCESS) {
+        LOG_INFO("process \"%s\" is alive", daemon->target);
+        return DS_ALIVE;
+    }
+
+    if (qs == QS_RECEIVE_TIMEOUT || qs == QS_NO_CONNECTION) {
+        if (-1 == kill(daemon->pid, 0) && errno == ESRCH) {
+            LOG_WARN("process \"%s\" is not responding", daemon->target);
+            return DS_NO_RESPONSE;
+        }
+
+        LOG_ERROR("process \"%s\" is not alive", daemon->target);
+        return DS_NOT_ALIVE;
+    }
+
+    return DS_SYSTEM_ERROR;
+}
+
+static void ovs_close_query(ovs_daemon_t * daemon)
+{
+    LOG_DBG("totally received %zu bytes", daemon->response_size);
+
+    loop_del_fd(daemon->probe_fd);
+    close(daemon->probe_fd);
+    daemon->probe_fd = -1;
+    wheel_timer_cancel(&daemon->deadline);
+}
+
+static void ovs_finish_query(ovs_daemon_t * daemon, query_status_t qs)
+{
+    ovs_close_query(daemon);
+
+    if (qs != QS_SUCCESS) {
+        LOG_DBG("failed to receive valid response: %s", daemon->response);
+    }
+
+    ovs_handle_status(daemon, ovs_probe_status(daemon, qs));
+}
+
+/*
+ * Deadline is derived from recent RTTs and is doubled after every
+ * consecutive miss, so an overloaded daemon gets more time before it is
+ * blamed. receive_timeout is used until enough RTTs are collected.
+ */
+static long ovs_probe_deadline(const ovs_daemon_t * daemon)
+{
+    const chandler_conf_t *conf = get_conf();
+    long                   receive_timeout = daemon->conf->receive_timeout? daemon->conf->receive_timeout: conf->receive_timeout;
+    uint64_t               deadline;
+
+    if (rtt_count(&daemon->rtts) < RTT_MIN_SAMPLES) {
+        return receive_timeout;
+    }
+
+    deadline = rtt_percentile(&daemon->rtts, conf->rtt_percentile) * (uint64_t)conf->rtt_factor / 1000;
+    if (deadline < (uint64_t)conf->receive_timeout_min) {
+        deadline = (uint64_t)conf->receive_timeout_min;
+    }
+
+    /* doubled after the clamp, otherwise all retries of a fast daemon get receive_timeout_min */
+    if (daemon->misses >= 32 || deadline > ((uint64_t)receive_timeout >> daemon->misses)) {
+        return receive_timeout;
+    }
+
+    return (long)(deadline << daemon->misses);
+}
+
+static void on_probe_deadline(void * ctx)
+{
+    ovs_daemon_t *daemon = ctx;
+
+    ++daemon->misses;
+
+    if (daemon->misses < get_conf()->deadline_misses) {
+        LOG_WARN("probe of \"%s\" has missed the deadline (%ld of %ld) - probing again", daemon->target, daemon->misses, get_conf()->deadline_misses);
+        ovs_close_query(daemon);
+        ovs_get_daemon_status(daemon);
+        return;
+    }
+
+    LOG_DBG("probe of \"%s\" has timed out", daemon->target);
+    ovs_finish_query(daemon, QS_RECEIVE_TIMEOUT);
+}
+
+static void on_probe_read(int fd, uint32_t events, void * ctx)
 {
-    static char rpc_request[] = "{\"id\":0,\"method\":\"list-commands\",\"params\":[]}";
-    static char rpc_response[MAX_RESPONSE_SIZE];
+    ovs_daemon_t           *daemon = ctx;
+    ovsdb_message_parser_t  parser;
+    ssize_t                 count;
+
+    (void)events;
+
+    count = recv(fd, daemon->response + daemon->response_size, sizeof(daemon->response) - daemon->response_size - 1, MSG_DONTWAIT);
+    if (count < 0) {
+        if (errno == EAGAIN || errno == EINTR) {
+            return;
+        }
+
+        LOG_DBG("recv failed: %d (%s)", errno, strerror(errno));
+        ovs_finish_query(daemon, QS_SOCKET_ERROR);
+        return;
+    }
+
+    if (count == 0) {
+        LOG_DBG("connection closed");
+        ovs_finish_query(daemon, QS_RECEIVE_TIMEOUT);
+        return;
+    }
+
+    LOG_DBG("received %zd bytes", count);
+    daemon->response_size += count;
+    daemon->response[daemon->response_size] = '\0';
+
+    if (parse_jrpc(&parser, daemon->response)) {
+        if (parser.id == 0 && parser.message_type == OVSDBMT_RESPONSE) {
+            daemon->rtt = time_monotonic_usec() - daemon->send_time;
+            rtt_add(&daemon->rtts, daemon->rtt);
+            metric_set(daemon->rtt_ewma, (long)rtt_ewma(&daemon->rtts));
+            ovs_check_slow(&daemon->rtts, daemon->name);
+            metric_observe(daemon->probe_rtt, daemon->rtt);
+            metric_observe(daemon->reply_size, daemon->response_size);
+            LOG_DBG("received valid JSON in response");
+            LOG_DBG("  id    : %ld", parser.id);
+            if (parser.result >= 0) {
+                LOG_DBG("  result: %s", daemon->response + parser.t[parser.result].start);
+            }
+            if (parser.error >= 0) {
+                LOG_DBG("  error : %s", daemon->response + parser.t[parser.error].start);
+            }
+            ovs_finish_query(daemon, QS_SUCCESS);
+            return;
+        }
+    }
+
+    if (sizeof(daemon->response) - 1 == daemon->response_size) {
+        // no space left to receive data
+        ovs_finish_query(daemon, QS_SYSTEM_ERROR);
+    }
+}
 
-    struct timeval          tv = {.tv_sec = get_conf()->receive_timeout / 1000, .tv_usec = 1000*(get_conf()->receive_timeout % 1000)};
+/* Starts a probe, its result is handled from the event loop unless an error is returned */
+query_status_t ovs_query_daemon(ovs_daemon_t * daemon, pid_t pid)
+{
+    char                    rpc_request[MAX_METHOD_SIZE + 64];
+    int                     request_size;
     char                    socket_name[MAX_PATH_SIZE];
     int                     fd;
     ssize_t                 count;
-    ssize_t                 total = 0;
     int                     error;
-    query_status_t          qstatus = QS_SUCCESS;
-    ovsdb_message_parser_t  parser;
+    uint64_t                start_time;
+    long                    deadline;
 
-    if (NULL == ovs_make_unix_socket_name(socket_name, sizeof(socket_name), target, pid))
+    if (NULL == ovs_make_unix_socket_name(socket_name, sizeof(socket_name), daemon->target, pid))
     {
-        LOG_ERROR("failed to get unix socket name for \"%s\"", target);
+        LOG_ERROR("failed to get unix socket name for \"%s\"", daemon->target);
         return QS_UNIX_SOCKET_NAME_ERROR;
     }
 
-    LOG_DBG("got unix socket name %s for \"%s\"", socket_name, target);
+    LOG_DBG("got unix socket name %s for \"%s\"", socket_name, daemon->target);
 
-    error = connect_unix_socket(SOCK_STREAM, socket_name, &fd);
+    start_time = time_monotonic_usec();
+    error = connect_unix_socket(SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, socket_name, &fd);
     if (error)
     {
         LOG_ERROR("failed to connect to unix socket %s: %d", socket_name, error);
@@ -134,14 +430,20 @@ query_status_t ovs_query_daemon(const char * target, pid_t pid)
         case ENETUNREACH:
         case ECONNREFUSED:
         case EADDRNOTAVAIL:
+        case EAGAIN:
             return QS_NO_CONNECTION;
         default:
             return QS_SOCKET_ERROR;
         }
     }
 
-    count = send(fd, rpc_request, sizeof(rpc_request) - 1, 0);
-    if (count != sizeof(rpc_request) - 1)
+    daemon->send_time = time_monotonic_usec();
+    metric_observe(daemon->connect_time, daemon->send_time - start_time);
+
+    request_size = snprintf(rpc_request, sizeof(rpc_request), "{\"id\":0,\"method\":\"%s\",\"params\":[]}", daemon->conf->probe);
+
+    count = send(fd, rpc_request, request_size, MSG_DONTWAIT | MSG_NOSIGNAL);
+    if (count != request_size)
     {
         LOG_ERROR("failed to send a request: %s", rpc_request);
         close(fd);
@@ -150,164 +452,1299 @@ query_status_t ovs_query_daemon(const char * target, pid_t pid)
 
     LOG_DBG("sent a request: %s", rpc_request);
 
-    if (setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv))) {
-        LOG_ERROR("failed to set SO_RCVTIMEO: %d (%s)", errno, strerror(errno));
+    if (loop_add_fd(fd, EPOLLIN, on_probe_read, daemon)) {
         close(fd);
-        return QS_SOCKET_ERROR;
+        return QS_SYSTEM_ERROR;
     }
 
-    for (;;)
-    {
-        count = recv(fd, rpc_response + total, sizeof(rpc_response) - total - 1, 0);
-        if (count < 0) {
-            // for timeout -1 is returned with errno set to EAGAIN or EWOULDBLOCK
-            switch (errno)
-            {
-            case EAGAIN:
-                qstatus = QS_RECEIVE_TIMEOUT;
-                break;
-            default:
-                qstatus = QS_SOCKET_ERROR;
-            }
+    daemon->probe_fd      = fd;
+    daemon->response_size = 0;
+    daemon->response[0]   = '\0';
+    deadline = ovs_probe_deadline(daemon);
+    metric_set(daemon->probe_deadline, deadline);
+    wheel_timer_start(&daemon->deadline, deadline, on_probe_deadline, daemon);
 
-            LOG_DBG("recv failed: %d (%s)", errno, strerror(errno));
-            break;
-        }
+    return QS_SUCCESS;
+}
 
-        if (count == 0) {
-            qstatus = QS_RECEIVE_TIMEOUT;
-            LOG_DBG("connection closed");
-            break;
-        }
+/* A starting daemon is probed only after it has created its control socket */
+static int ovs_is_ctl_present(const ovs_daemon_t * daemon, pid_t pid)
+{
+    char socket_name[MAX_PATH_SIZE];
 
-        LOG_DBG("received %zd bytes", count);
-        total += count;
+    if (0 == strcmp(daemon->conf->probe, PROBE_PROCESS)) {
+        return 1;
+    }
 
-        rpc_response[total] = '\0';
-        if (parse_jrpc(&parser, rpc_response)) {
-            if (parser.id == 0 && parser.message_type == OVSDBMT_RESPONSE) {
-                LOG_DBG("received valid JSON in response");
-                LOG_DBG("  id    : %ld", parser.id);
-                if (parser.result >= 0) {
-                    LOG_DBG("  result: %s", rpc_response + parser.t[parser.result].start);
-                }
-                if (parser.error >= 0) {
-                    LOG_DBG("  error : %s", rpc_response + parser.t[parser.error].start);
-                }
-                break;
-            }
+    return NULL != ovs_make_unix_socket_name(socket_name, sizeof(socket_name), daemon->target, pid) && 0 == access(socket_name, F_OK);
+}
+
+void ovs_get_daemon_status(ovs_daemon_t * daemon)
+{
+    pid_t          pid;
+    query_status_t qs;
+
+    int            is_starting = daemon->spawn_time != 0;
+
+    if (!is_starting) {
+        LOG_INFO("checking process \"%s\"...", daemon->target);
+    }
+
+    pid = ovs_get_pid(daemon->target, daemon->pidfile);
+
+    if (pid <= 0) {
+        if (!is_starting) {
+            LOG_WARN("failed to get pid from pidfile for process \"%s\"", daemon->target);
         }
+        pid = find_process(daemon->name);
+    }
 
-        if ((ssize_t)sizeof(rpc_response) - 1 == total) {
-            // no space left to receive data
-            qstatus = QS_SYSTEM_ERROR;
-            break;
+    daemon->pid = pid;
+
+    if (pid <= 0 || (is_starting && !ovs_is_ctl_present(daemon, pid)))
+    {
+        if (!is_starting) {
+            LOG_ERROR("failed to find pid by name for process \"%s\"", daemon->target);
         }
+        ovs_handle_status(daemon, DS_NO_PROCESS);
+        return;
     }
 
-    LOG_DBG("totally received %zd bytes", total);
+    LOG_DBG("found process \"%s\" with pid: %d", daemon->target, pid);
 
-    close(fd);
+    if (0 == strcmp(daemon->conf->probe, PROBE_PROCESS)) {
+        ovs_handle_status(daemon, (-1 == kill(pid, 0) && errno == ESRCH)? DS_NO_PROCESS: ovs_probe_status(daemon, QS_SUCCESS));
+        return;
+    }
 
-    if (qstatus != QS_SUCCESS) {
-        LOG_DBG("failed to receive valid response: %s", rpc_response);
+    qs = ovs_query_daemon(daemon, pid);
+    if (qs != QS_SUCCESS) {
+        ovs_handle_status(daemon, ovs_probe_status(daemon, qs));
     }
+}
 
-    return qstatus;
+static void ovs_count_failure(void)
+{
+    chandler_stat()->failures_count += 1;
+    stat_window_add(&chandler_stat()->recent_failures, time_realtime_usec());
 }
 
-daemon_status_t ovs_get_daemon_status(const char * target, const char * pidfile, pid_t * out_pid)
+static void on_retry(void * ctx);
+
+/* Logs complete lines of the output, the last incomplete line is kept until the rest of it is read */
+static void ovs_log_output(ovs_daemon_t * daemon, int is_final)
 {
-    pid_t          pid;
-    query_status_t qs;
+    char   *line = daemon->output;
+    char   *end;
+    size_t  left = daemon->output_size;
+
+    while (left > 0 && (end = memchr(line, '\n', left)) != NULL) {
+        *end = '\0';
+        LOG_INFO("[%s] %s", daemon->name, line);
+        left -= end + 1 - line;
+        line  = end + 1;
+    }
 
-    LOG_INFO("checking process \"%s\"...", target);
+    /* a line too long for the buffer is logged in parts */
+    if (left > 0 && (is_final || left == sizeof(daemon->output) - 1)) {
+        line[left] = '\0';
+        LOG_INFO("[%s] %s", daemon->name, line);
+        left = 0;
+    }
 
-    pid = ovs_get_pid(target, pidfile);
+    memmove(daemon->output, line, left);
+    daemon->output_size = left;
+}
 
-    if (pid <= 0) {
-        LOG_WARN("failed to get pid from pidfile for process \"%s\"", target);
-        pid = find_process(target);
+static void ovs_close_output(ovs_daemon_t * daemon)
+{
+    ovs_log_output(daemon, 1);
+    loop_del_fd(daemon->output_fd);
+    close(daemon->output_fd);
+    daemon->output_fd = -1;
+}
+
+static void on_daemon_output(int fd, uint32_t events, void * ctx)
+{
+    ovs_daemon_t *daemon = ctx;
+    ssize_t       count;
+
+    (void)events;
+
+    /* output is read straight into the line buffer of the daemon */
+    count = read(fd, daemon->output + daemon->output_size, sizeof(daemon->output) - 1 - daemon->output_size);
+    if (count > 0) {
+        daemon->output_size += count;
+        ovs_log_output(daemon, 0);
+        return;
     }
 
-    *out_pid = pid;
+    if (count < 0 && (errno == EAGAIN || errno == EINTR)) {
+        return;
+    }
 
-    if (pid <= 0)
-    {
-        LOG_ERROR("failed to find pid by name for process \"%s\"", target);
-        return DS_NO_PROCESS;
+    ovs_close_output(daemon);
+}
+
+/* Stops logging output of the child when its entry is dropped or rebound to another service */
+static void ovs_forget_child(ovs_daemon_t * daemon)
+{
+    if (daemon->output_fd != -1) {
+        ovs_close_output(daemon);
     }
 
-    LOG_DBG("found process \"%s\" with pid: %d", target, pid);
+    daemon->child_pid = 0;
+}
 
-    qs = ovs_query_daemon(target, pid);
+/* Runs the daemon in the foreground, its exit is reported by ovs_on_child_exit() */
+static int ovs_spawn_child(ovs_daemon_t * daemon)
+{
+    int fds[2];
 
-    if (qs == QS_SUCCESS) {
-        LOG_INFO("process \"%s\" is alive", target);
-        return DS_ALIVE;
+    if (daemon->output_fd != -1) {
+        ovs_close_output(daemon);
     }
 
-    if (qs == QS_RECEIVE_TIMEOUT || qs == QS_NO_CONNECTION) {
-        if (-1 == kill(pid, 0) && errno == ESRCH) {
-            LOG_WARN("process \"%s\" is not responding", target);
-            return DS_NO_RESPONSE;
-        }
+    if (open_output_pipe(fds) != 0) {
+        return -1;
+    }
 
-        LOG_ERROR("process \"%s\" is not alive", target);
-        return DS_NOT_ALIVE;
+    daemon->child_pid = spawner_run(daemon->cmd, fds[1], 1, &daemon->policy);
+    close(fds[1]);
+
+    if (daemon->child_pid == -1) {
+        daemon->child_pid = 0;
+        close(fds[0]);
+        return -1;
     }
 
-    return DS_SYSTEM_ERROR;
+    if (loop_add_fd(fds[0], EPOLLIN, on_daemon_output, daemon) != 0) {
+        LOG_WARN("output of \"%s\" is not logged", daemon->name);
+        close(fds[0]);
+        return 0;
+    }
+
+    daemon->output_fd   = fds[0];
+    daemon->output_size = 0;
+    return 0;
 }
 
-void ovs_check_daemon(const char * target, const char * pidfile, const char * cmd) {
-    long           retries_count = get_conf()->request_retries;
-    pid_t          pid;
-    daemon_status_t status;
+static void ovs_spawn_daemon(ovs_daemon_t * daemon)
+{
+    if (0 != (get_conf()->supervise? ovs_spawn_child(daemon): (spawner_run(daemon->cmd, -1, 0, &daemon->policy) > 0? 0: -1))) {
+        LOG_ERROR("failed to spawn a process for \"%s\"", daemon->target);
+        ovs_count_failure();
+        event_emit(EV_SPAWN, daemon->name, "failed to spawn");
+        return;
+    }
 
-    if (retries_count <= 0)
-        retries_count = 1;
+    LOG_INFO("spawned a new process from command: %s", daemon->cmd);
+    chandler_stat()->restarts_count += 1;
+    daemon->spawn_time   = time_monotonic_usec();
+    daemon->restart_time = daemon->spawn_time;
+    daemon->status       = DS_NO_PROCESS;
 
-    for (; retries_count; --retries_count)
-    {
-        status = ovs_get_daemon_status(target, pidfile, &pid);
-        if (status == DS_ALIVE)
-            return;
+    if (daemon->is_planned_stop) {
+        g_planned_restarts += 1;
+    }
+    else {
+        stat_window_add(&chandler_stat()->recent_restarts, time_realtime_usec());
+    }
+    daemon->is_planned_stop = 0;
 
-        if (status != DS_NO_RESPONSE)
-            break;
+    event_emit(EV_SPAWN, daemon->name, daemon->cmd);
 
-        LOG_WARN("check attempt %ld of %ld has failed - retrying", get_conf()->request_retries - retries_count + 1, get_conf()->request_retries);
-    }
+    /* readiness is polled until the first successful probe or startup_grace */
+    wheel_timer_start(&daemon->deadline, STARTUP_POLL_MSEC, on_retry, daemon);
+}
 
-    if (status == DS_NOT_ALIVE) {
-        LOG_WARN("trying to kill the process \"%s\" with pid %d: %d (%s)", target, pid, errno, strerror(errno));
-        if (-1 == kill(pid, SIGKILL)) {
-            if (errno == EINVAL || errno == EPERM) {
-                LOG_ERROR("failed to kill process \"%s\" with pid %d: %d (%s)", target, pid, errno, strerror(errno));
-                chandler_stat()->failures_count += 1;
-                return;
-            }
+static int ovs_is_daemon_ready(const ovs_daemon_t * daemon)
+{
+    return daemon->status == DS_ALIVE && daemon->spawn_time == 0 && !daemon->is_waiting;
+}
+
+static int ovs_are_deps_ready(const ovs_daemon_t * daemon)
+{
+    for (size_t i = 0; i < daemon->deps_count; ++i) {
+        if (!ovs_is_daemon_ready(&g_daemons[daemon->deps[i]])) {
+            return 0;
         }
-        else {
-            LOG_WARN("killed the process \"%s\" with pid %d: %d (%s)", target, pid, errno, strerror(errno));
-            chandler_stat()->kills_count += 1;
+    }
+
+    return 1;
+}
+
+/* Spawns the daemon or postpones the spawn until its dependencies are ready */
+static void ovs_start_daemon(ovs_daemon_t * daemon)
+{
+    if (!ovs_are_deps_ready(daemon)) {
+        LOG_INFO("\"%s\" is waiting for its dependencies to become ready", daemon->name);
+        daemon->is_waiting = 1;
+        return;
+    }
+
+    daemon->is_waiting = 0;
+    ovs_spawn_daemon(daemon);
+}
+
+/* Starts services which have been waiting for the daemon */
+static void ovs_start_dependents(void)
+{
+    for (long i = 0; i < g_daemons_count; ++i) {
+        ovs_daemon_t *dependent = &g_daemons[g_order[i]];
+
+        if (dependent->is_waiting && ovs_are_deps_ready(dependent)) {
+            ovs_start_daemon(dependent);
         }
     }
+}
+
+static void on_spawn_due(void * ctx)
+{
+    ovs_daemon_t *daemon = ctx;
+
+    ovs_start_daemon(daemon);
+    chandler_log_incident();
+}
+
+/*
+ * A spawned daemon is not checked as usual until it becomes ready: a failed
+ * probe just means it is still starting. Returns 1 if the status has been
+ * consumed by the startup.
+ */
+static int ovs_handle_startup(ovs_daemon_t * daemon, daemon_status_t status)
+{
+    const service_conf_t *conf = daemon->conf;
+    uint64_t              now = time_monotonic_usec();
+    long                  grace = conf->startup_grace? conf->startup_grace: get_conf()->startup_grace;
+
+    if (status == DS_ALIVE) {
+        LOG_INFO("\"%s\" is ready in %lu ms", daemon->name, (unsigned long)((now - daemon->spawn_time) / 1000));
+        metric_observe(daemon->spawn_to_ready, now - daemon->spawn_time);
+        daemon->spawn_time = 0;
+        event_emit(EV_READY, daemon->name, NULL);
+        ovs_start_dependents();
+        return 1;
+    }
 
-    // => DS_NO_PROCESS:
-    if (0 != spawn_process_from_command(cmd)) {
-        LOG_ERROR("failed to spawn a process for \"%s\"", target);
-        chandler_stat()->failures_count += 1;
+    if (now - daemon->spawn_time < (uint64_t)grace * 1000) {
+        wheel_timer_start(&daemon->deadline, STARTUP_POLL_MSEC, on_retry, daemon);
+        return 1;
+    }
+
+    LOG_ERROR("\"%s\" has not become ready within %ld msec", daemon->name, grace);
+    daemon->spawn_time   = 0;
+    daemon->retries_left = 0;
+    return 0;
+}
+
+/*
+ * A daemon which stayed up for restart_backoff_max since its last relaunch
+ * is respawned right away. Otherwise the relaunch is delayed, starting with
+ * restart_backoff_min and doubling every time, so that a crash loop is slowed
+ * down regardless of how long chandler has been running.
+ */
+static void ovs_schedule_spawn(ovs_daemon_t * daemon)
+{
+    uint64_t since_restart = (time_monotonic_usec() - daemon->restart_time) / 1000;
+
+    if (daemon->restart_time == 0 || since_restart >= (uint64_t)get_conf()->restart_backoff_max) {
+        daemon->backoff = 0;
+    }
+    else if (daemon->backoff == 0) {
+        daemon->backoff = get_conf()->restart_backoff_min;
     }
     else {
-        LOG_INFO("spawned a new process from command: %s", cmd);
-        chandler_stat()->restarts_count += 1;
+        daemon->backoff = (daemon->backoff > get_conf()->restart_backoff_max / 2)? get_conf()->restart_backoff_max: daemon->backoff * 2;
+    }
+
+    metric_set(daemon->restart_backoff, daemon->backoff);
+
+    if (since_restart >= (uint64_t)daemon->backoff) {
+        ovs_start_daemon(daemon);
+        return;
     }
+
+    LOG_WARN("postponing relaunch of \"%s\" for %ld msec", daemon->target, daemon->backoff - (long)since_restart);
+    wheel_timer_start(&daemon->deadline, daemon->backoff - (long)since_restart, on_spawn_due, daemon);
 }
 
-void check_ovs(void)
+static void on_retry(void * ctx)
+{
+    ovs_get_daemon_status(ctx);
+}
+
+static void ovs_spawn_all(void);
+
+static int ovs_is_stopping(void)
+{
+    for (long i = 0; i < g_daemons_count; ++i) {
+        if (g_daemons[i].stop_pid) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/* Removes files the exited process may have left behind, so that its successor does not race them */
+static void ovs_remove_stale_files(ovs_daemon_t * daemon, pid_t pid)
+{
+    char path[MAX_PATH_SIZE];
+
+    if (ovs_get_pid(daemon->target, daemon->pidfile) == pid && ovs_make_pidfile_name(path, sizeof(path), daemon->target, daemon->pidfile)) {
+        LOG_DBG("removing stale pidfile %s", path);
+        unlink(path);
+    }
+
+    if (0 != strcmp(daemon->conf->probe, PROBE_PROCESS) && ovs_make_unix_socket_name(path, sizeof(path), daemon->target, pid)) {
+        LOG_DBG("removing stale control socket %s", path);
+        unlink(path);
+    }
+}
+
+static void ovs_on_stopped(ovs_daemon_t * daemon)
+{
+    pid_t pid = daemon->stop_pid;
+
+    if (daemon->stop_fd != -1) {
+        loop_del_fd(daemon->stop_fd);
+        close(daemon->stop_fd);
+        daemon->stop_fd = -1;
+    }
+
+    wheel_timer_cancel(&daemon->deadline);
+    daemon->stop_pid = 0;
+
+    ovs_remove_stale_files(daemon, pid);
+
+    if (!g_is_restarting_all) {
+        ovs_schedule_spawn(daemon);
+    }
+    else if (!ovs_is_stopping()) {
+        ovs_spawn_all();
+    }
+}
+
+static void on_daemon_exit(int fd, uint32_t events, void * ctx)
+{
+    ovs_daemon_t *daemon = ctx;
+
+    (void)fd;
+    (void)events;
+
+    LOG_INFO("process \"%s\" with pid %d has exited", daemon->target, daemon->stop_pid);
+    ovs_on_stopped(daemon);
+    chandler_log_incident();
+}
+
+/* Time in msec to wait for the process to exit after the signal */
+static long ovs_stop_timeout(int signo)
+{
+    if (signo == SIGKILL && get_conf()->kill_timeout <= 0) {
+        return KILL_TIMEOUT_MSEC;
+    }
+
+    return get_conf()->kill_timeout;
+}
+
+/* Sends SIGKILL when SIGTERM has not helped, and gives up when SIGKILL has not helped either */
+static void on_stop_deadline(void * ctx)
 {
-    ovs_check_daemon(get_conf()->ovs_name_db, get_conf()->ovs_pidfile_db, get_conf()->ovs_cmd_db);
-    ovs_check_daemon(get_conf()->ovs_name_switch, get_conf()->ovs_pidfile_switch, get_conf()->ovs_cmd_switch);
+    ovs_daemon_t *daemon = ctx;
+
+    /* without pidfd exit of the process is only noticed here */
+    if (-1 == kill(daemon->stop_pid, 0) && errno == ESRCH) {
+        LOG_INFO("process \"%s\" with pid %d has exited", daemon->target, daemon->stop_pid);
+    }
+    else if (daemon->stop_signal == SIGTERM && 0 == kill(daemon->stop_pid, SIGKILL)) {
+        LOG_WARN("process \"%s\" with pid %d has ignored SIGTERM - sending SIGKILL", daemon->target, daemon->stop_pid);
+        daemon->stop_signal = SIGKILL;
+        wheel_timer_start(&daemon->deadline, ovs_stop_timeout(SIGKILL), on_stop_deadline, daemon);
+        return;
+    }
+    else if (daemon->stop_signal == SIGKILL) {
+        LOG_ERROR("process \"%s\" with pid %d has not exited after SIGKILL", daemon->target, daemon->stop_pid);
+        ovs_count_failure();
+    }
+
+    ovs_on_stopped(daemon);
+    chandler_log_incident();
+}
+
+/*
+ * Sends SIGTERM (or SIGKILL if kill_timeout is 0) and waits for the process
+ * to exit on its pidfd in the event loop. The daemon is spawned again when
+ * the process has exited. Returns 1 if the process has already gone and
+ * -1 if it can't be signalled.
+ */
+static int ovs_stop_daemon(ovs_daemon_t * daemon, pid_t pid, const char * reason)
+{
+    int signo = get_conf()->kill_timeout > 0? SIGTERM: SIGKILL;
+
+    LOG_WARN("trying to %s the process \"%s\" with pid %d", signo == SIGTERM? "stop": "kill", daemon->target, pid);
+
+    daemon->stop_pid    = pid;
+    daemon->stop_signal = signo;
+    /* exit of a child is reported by SIGCHLD along with its status */
+    daemon->stop_fd     = pid != daemon->child_pid? process_open_fd(pid): -1;
+
+    if (-1 == kill(pid, signo)) {
+        if (errno == EINVAL || errno == EPERM) {
+            LOG_ERROR("failed to kill process \"%s\" with pid %d: %d (%s)", daemon->target, pid, errno, strerror(errno));
+            if (daemon->stop_fd != -1) {
+                close(daemon->stop_fd);
+                daemon->stop_fd = -1;
+            }
+            daemon->stop_pid = 0;
+            ovs_count_failure();
+            return -1;
+        }
+
+        /* the process has already gone */
+        if (daemon->stop_fd != -1) {
+            close(daemon->stop_fd);
+            daemon->stop_fd = -1;
+        }
+        daemon->stop_pid = 0;
+        ovs_remove_stale_files(daemon, pid);
+        return 1;
+    }
+
+    LOG_WARN("sent %s to the process \"%s\" with pid %d", signo == SIGTERM? "SIGTERM": "SIGKILL", daemon->target, pid);
+    chandler_stat()->kills_count += 1;
+    event_emit(EV_KILL, daemon->name, reason);
+
+    if (pid == daemon->child_pid) {
+        LOG_DBG("waiting for SIGCHLD from the process \"%s\"", daemon->target);
+    }
+    else if (daemon->stop_fd == -1 || loop_add_fd(daemon->stop_fd, EPOLLIN, on_daemon_exit, daemon) != 0) {
+        /* without pidfd the process is given the whole timeout */
+        LOG_WARN("failed to watch exit of the process \"%s\" with pid %d", daemon->target, pid);
+        if (daemon->stop_fd != -1) {
+            close(daemon->stop_fd);
+            daemon->stop_fd = -1;
+        }
+    }
+
+    wheel_timer_start(&daemon->deadline, ovs_stop_timeout(signo), on_stop_deadline, daemon);
+    return 0;
+}
+
+static void ovs_restart_daemon(ovs_daemon_t * daemon, daemon_status_t status)
+{
+    if (   (status == DS_NOT_ALIVE || status == DS_STUCK)
+        && ovs_stop_daemon(daemon, daemon->pid, status == DS_STUCK? daemon->stuck_detail: "not responding") <= 0)
+    {
+        return;
+    }
+
+    // => DS_NO_PROCESS:
+    ovs_schedule_spawn(daemon);
+}
+
+static void ovs_cancel_check(ovs_daemon_t * daemon)
+{
+    if (daemon->probe_fd != -1) {
+        ovs_close_query(daemon);
+    }
+
+    if (daemon->stop_fd != -1) {
+        loop_del_fd(daemon->stop_fd);
+        close(daemon->stop_fd);
+        daemon->stop_fd = -1;
+    }
+
+    daemon->stop_pid        = 0;
+    daemon->is_planned_stop = 0;
+    wheel_timer_cancel(&daemon->deadline);
+}
+
+static void ovs_spawn_all(void)
+{
+    g_is_restarting_all = 0;
+
+    for (long i = 0; i < g_daemons_count; ++i) {
+        ovs_start_daemon(&g_daemons[g_order[i]]);
+    }
+}
+
+/*
+ * Stops all services, dependent ones first, and spawns them again in
+ * dependency order once all of them have exited. Checks in progress are
+ * dropped, so the stopped services are not blamed once more.
+ */
+static void ovs_restart_all(void)
+{
+    ovs_daemon_t *daemon;
+    pid_t         pid;
+
+    g_is_restarting_all = 1;
+
+    for (long i = 0; i < g_daemons_count; ++i) {
+        ovs_cancel_check(&g_daemons[i]);
+        g_daemons[i].status     = DS_NO_PROCESS;
+        g_daemons[i].spawn_time = 0;
+        g_daemons[i].is_waiting = 0;
+    }
+
+    for (long i = g_daemons_count; i-- > 0;) {
+        daemon = &g_daemons[g_order[i]];
+
+        pid = ovs_get_pid(daemon->target, daemon->pidfile);
+        if (pid > 0) {
+            ovs_stop_daemon(daemon, pid, "restarting all services");
+        }
+    }
+
+    if (g_is_restarting_all && !ovs_is_stopping()) {
+        ovs_spawn_all();
+    }
+}
+
+static void ovs_handle_status(ovs_daemon_t * daemon, daemon_status_t status)
+{
+    escalation_action_t action;
+
+    daemon->status     = status;
+    daemon->check_time = time_monotonic_usec();
+    daemon->misses     = 0;
+
+    if (daemon->spawn_time && ovs_handle_startup(daemon, status))
+        return;
+
+    if (status == DS_ALIVE)
+        return;
+
+    if (g_handlers != NULL) {
+        g_handlers->on_anomaly();
+    }
+
+    if (status == DS_NO_RESPONSE && --daemon->retries_left > 0)
+    {
+        LOG_WARN("check attempt %ld of %ld has failed - retrying", get_conf()->request_retries - daemon->retries_left, get_conf()->request_retries);
+        wheel_timer_start(&daemon->deadline, get_conf()->recheck_interval, on_retry, daemon);
+        return;
+    }
+
+    event_emit(EV_PROBE_FAILURE, daemon->name, ovs_status_name(status));
+
+    action = escalation_next(&daemon->escalation, daemon->name, time_monotonic_usec());
+    if (action != EA_RESTART) {
+        event_emit(EV_ESCALATE, daemon->name, escalation_action_name(action));
+    }
+
+    switch (action)
+    {
+    case EA_RESTART_ALL:
+        ovs_restart_all();
+        break;
+    case EA_COMMAND:
+    case EA_REBOOT:
+        if (g_handlers != NULL) {
+            g_handlers->on_escalation(action);
+        }
+        /* the daemon must not stay down while the hook runs or if the reboot is suppressed */
+        ovs_restart_daemon(daemon, status);
+        break;
+    default:
+        ovs_restart_daemon(daemon, status);
+    }
+
+    chandler_log_incident();
+}
+
+int ovs_on_child_exit(pid_t pid, int status)
+{
+    ovs_daemon_t *daemon = NULL;
+    char          detail[64];
+
+    for (long i = 0; i < g_daemons_count && daemon == NULL; ++i) {
+        if (g_daemons[i].child_pid == pid) {
+            daemon = &g_daemons[i];
+        }
+    }
+
+    if (daemon == NULL) {
+        return 0;
+    }
+
+    daemon->child_pid = 0;
+
+    if (WIFSIGNALED(status)) {
+        snprintf(detail, sizeof(detail), "killed by signal %d", WTERMSIG(status));
+    }
+    else {
+        snprintf(detail, sizeof(detail), "exited with status %d", WEXITSTATUS(status));
+    }
+
+    event_emit(EV_EXIT, daemon->name, detail);
+
+    if (daemon->stop_pid == pid) {
+        LOG_INFO("process \"%s\" with pid %d has %s", daemon->target, pid, detail);
+        ovs_on_stopped(daemon);
+        chandler_log_incident();
+        return 1;
+    }
+
+    LOG_ERROR("process \"%s\" with pid %d has unexpectedly %s", daemon->target, pid, detail);
+
+    if (g_is_restarting_all) {
+        return 1;
+    }
+
+    /* the death is known for sure, so neither probes nor the rest of startup_grace are waited for */
+    ovs_cancel_check(daemon);
+    daemon->spawn_time   = 0;
+    daemon->retries_left = 0;
+    ovs_handle_status(daemon, DS_NO_PROCESS);
+    return 1;
+}
+
+static void on_cgroup_event(void * ctx, cgroup_event_t event, long count)
+{
+    ovs_daemon_t *daemon = ctx;
+    uint64_t      now = time_monotonic_usec();
+    char          detail[64];
+
+    switch (event)
+    {
+    case CE_OOM_KILL:
+        LOG_ERROR("%ld processes of \"%s\" have been killed by OOM killer", count, daemon->name);
+        snprintf(detail, sizeof(detail), "%ld processes", count);
+        metric_add(daemon->oom_kills, count);
+        event_emit(EV_OOM_KILL, daemon->name, detail);
+        chandler_log_incident();
+        break;
+
+    case CE_MEMORY_HIGH:
+    case CE_MEMORY_MAX:
+        /* reclaim may report these many times per second, so they are reported in batches */
+        metric_add(daemon->memory_high, count);
+        daemon->throttles += count;
+        if (now - daemon->throttle_time >= THROTTLE_REPORT_MSEC * 1000) {
+            LOG_WARN("\"%s\" has hit its memory limit %ld times", daemon->name, daemon->throttles);
+            snprintf(detail, sizeof(detail), "%s: %ld times", event == CE_MEMORY_MAX? "memory.max": "memory.high", daemon->throttles);
+            event_emit(EV_THROTTLE, daemon->name, detail);
+            daemon->throttle_time = now;
+            daemon->throttles     = 0;
+        }
+        break;
+
+    default:
+        /* CE_EMPTY: the daemon has gone, no need to wait for the next check to notice that */
+        LOG_WARN("all processes of \"%s\" have left its cgroup", daemon->name);
+        ovs_check_daemon(daemon);
+    }
+}
+
+static void ovs_bind_cgroup(ovs_daemon_t * daemon)
+{
+    const char *limits[] = {daemon->conf->memory_high, daemon->conf->memory_max, daemon->conf->cpu_max};
+    const char *root     = get_conf()->cgroup_root;
+
+    daemon->policy.cgroup[0] = '\0';
+
+    if (root[0] == '\0') {
+        cgroup_close(&daemon->cgroup);
+        return;
+    }
+
+    if (cgroup_open(&daemon->cgroup, root, daemon->name, limits, on_cgroup_event, daemon) == 0) {
+        strcpy(daemon->policy.cgroup, daemon->cgroup.path);
+    }
+}
+
+/* Plans a restart of the daemon whose memory has grown over pss_growth since its first sample */
+static void ovs_check_growth(ovs_daemon_t * daemon)
+{
+    uint64_t usage = daemon->sample.pss? daemon->sample.pss: daemon->sample.rss;
+    char     detail[96];
+
+    if (daemon->pss_baseline == 0) {
+        daemon->pss_baseline = usage;
+        return;
+    }
+
+    if (daemon->conf->pss_growth <= 0 || daemon->is_restart_planned
+        || usage < daemon->pss_baseline + (uint64_t)daemon->conf->pss_growth)
+    {
+        return;
+    }
+
+    LOG_WARN("memory of \"%s\" has grown from %lu kB to %lu kB - planning a restart",
+        daemon->name, (unsigned long)daemon->pss_baseline, (unsigned long)usage);
+    snprintf(detail, sizeof(detail), "%s %lu kB -> %lu kB", daemon->sample.pss? "pss": "rss",
+        (unsigned long)daemon->pss_baseline, (unsigned long)usage);
+    event_emit(EV_LEAK, daemon->name, detail);
+    daemon->is_restart_planned = 1;
+}
+
+static int ovs_find_thread_group(const thread_groups_t * groups, const char * name)
+{
+    for (size_t i = 0; i < groups->count; ++i) {
+        const char *prefix = groups->groups[i].prefix;
+
+        if (0 == strncmp(name, prefix, strlen(prefix))) {
+            return (int)i;
+        }
+    }
+
+    return -1;
+}
+
+/* Reports threads which have stayed busy for busy_window and takes busy_action once they are */
+static void ovs_check_busy(ovs_daemon_t * daemon)
+{
+    const proc_threads_t *threads = &daemon->proc_threads;
+    uint64_t              window = (uint64_t)get_conf()->busy_window * 1000;
+    long                  counts[MAX_THREAD_GROUPS] = {0};
+    char                  detail[MAX_THREADS_DETAIL_SIZE] = "";
+    size_t                length = 0;
+    long                  total = 0;
+    int                   group;
+
+    for (size_t i = 0; i < threads->count; ++i) {
+        const proc_thread_t *thread = &threads->threads[i];
+
+        if (thread->busy_since == 0 || threads->sample_time - thread->busy_since < window) {
+            continue;
+        }
+
+        group = ovs_find_thread_group(&daemon->busy_groups, thread->name);
+        if (group < 0) {
+            continue;
+        }
+
+        counts[group] += 1;
+        total         += 1;
+
+        if (length < sizeof(detail)) {
+            length += snprintf(detail + length, sizeof(detail) - length, "%s%s %ld%%", length? ", ": "", thread->name, thread->usage);
+        }
+    }
+
+    for (size_t i = 0; i < daemon->busy_groups.count; ++i) {
+        metric_set(daemon->busy_groups.groups[i].metric, counts[i]);
+    }
+
+    strcpy(daemon->busy_detail, detail);
+
+    if (total == 0) {
+        if (daemon->is_busy) {
+            LOG_INFO("threads of \"%s\" are not saturated anymore", daemon->name);
+        }
+        daemon->is_busy = 0;
+        return;
+    }
+
+    if (daemon->is_busy) {
+        return;
+    }
+
+    daemon->is_busy = 1;
+    LOG_WARN("%ld threads of \"%s\" have been saturated for %ld msec: %s", total, daemon->name, get_conf()->busy_window, detail);
+    event_emit(EV_BUSY, daemon->name, detail);
+    chandler_log_incident();
+
+    switch (daemon->busy_action)
+    {
+    case EA_RESTART_ALL:
+        event_emit(EV_ESCALATE, daemon->name, escalation_action_name(EA_RESTART_ALL));
+        ovs_restart_all();
+        break;
+    case EA_COMMAND:
+    case EA_REBOOT:
+        event_emit(EV_ESCALATE, daemon->name, escalation_action_name(daemon->busy_action));
+        if (g_handlers != NULL) {
+            g_handlers->on_escalation(daemon->busy_action);
+        }
+        /* the daemon is restarted too, see ovs_sample_daemon() */
+        break;
+    default:
+        /* restart is made by ovs_sample_daemon() once no check is in progress */
+        break;
+    }
+}
+
+/*
+ * A thread is stuck when it has made no CPU progress for stuck_timeout while
+ * in uninterruptible sleep or waiting on a futex (a lock it may never get).
+ * Futex waits are only recognized if the kernel exposes wait channels.
+ */
+static int ovs_is_thread_stuck(const ovs_daemon_t * daemon, const proc_thread_t * thread, char * wchan, size_t size)
+{
+    uint64_t timeout = (uint64_t)get_conf()->stuck_timeout * 1000;
+
+    if (   (thread->state != 'D' && thread->state != 'S')
+        || daemon->proc_threads.sample_time - thread->progress_time < timeout
+    )
+    {
+        return 0;
+    }
+
+    if (proc_read_wchan(&daemon->proc, thread->tid, wchan, size) != 0) {
+        snprintf(wchan, size, "0");
+    }
+
+    wchan[strcspn(wchan, "\n")] = '\0';
+    return thread->state == 'D' || 0 == strncmp(wchan, "futex", sizeof("futex") - 1);
+}
+
+/* Reports threads which have stopped making progress, the next check blames the daemon for them */
+static void ovs_check_stuck(ovs_daemon_t * daemon)
+{
+    const proc_threads_t *threads = &daemon->proc_threads;
+    long                  counts[MAX_THREAD_GROUPS] = {0};
+    char                  detail[MAX_THREADS_DETAIL_SIZE] = "";
+    char                  wchan[64];
+    size_t                length = 0;
+    long                  total = 0;
+    int                   group;
+
+    for (size_t i = 0; i < threads->count; ++i) {
+        const proc_thread_t *thread = &threads->threads[i];
+
+        group = ovs_find_thread_group(&daemon->stuck_groups, thread->name);
+        if (group < 0 || !ovs_is_thread_stuck(daemon, thread, wchan, sizeof(wchan))) {
+            continue;
+        }
+
+        counts[group] += 1;
+        total         += 1;
+
+        if (length < sizeof(detail)) {
+            length += snprintf(detail + length, sizeof(detail) - length, "%s%s %c %s", length? ", ": "", thread->name, thread->state, wchan);
+        }
+    }
+
+    for (size_t i = 0; i < daemon->stuck_groups.count; ++i) {
+        metric_set(daemon->stuck_groups.groups[i].metric, counts[i]);
+    }
+
+    strcpy(daemon->stuck_detail, detail);
+
+    if (total == 0) {
+        if (daemon->stuck_count) {
+            LOG_INFO("threads of \"%s\" are making progress again", daemon->name);
+        }
+        daemon->stuck_count = 0;
+        return;
+    }
+
+    if (daemon->stuck_count == 0) {
+        LOG_ERROR("%ld threads of \"%s\" have made no progress for %ld msec: %s", total, daemon->name, get_conf()->stuck_timeout, detail);
+        event_emit(EV_STUCK, daemon->name, detail);
+        chandler_log_incident();
+    }
+
+    daemon->stuck_count = total;
+
+    /* the daemon answers probes, so only a check can notice that */
+    ovs_check_daemon(daemon);
+}
+
+static void ovs_close_proc(ovs_daemon_t * daemon)
+{
+    proc_close(&daemon->proc);
+    proc_close_threads(&daemon->proc_threads);
+}
+
+static void ovs_sample_daemon(ovs_daemon_t * daemon)
+{
+    int error;
+    int in_window;
+
+    /* only a steady process is sampled, the others are being handled by checks */
+    if (   daemon->status != DS_ALIVE || daemon->pid <= 0 || daemon->spawn_time || daemon->is_waiting
+        || daemon->stop_pid || g_is_restarting_all
+    )
+    {
+        return;
+    }
+
+    if (daemon->proc.pid != daemon->pid) {
+        error = proc_open(&daemon->proc, daemon->pid);
+        if (error) {
+            LOG_DBG("failed to open /proc files of \"%s\" with pid %d: %d (%s)", daemon->name, (int)daemon->pid, error, strerror(error));
+            return;
+        }
+
+        proc_close_threads(&daemon->proc_threads);
+        daemon->pss_baseline       = 0;
+        daemon->is_restart_planned = 0;
+        daemon->is_busy            = 0;
+        daemon->stuck_count        = 0;
+    }
+
+    error = proc_sample(&daemon->proc, &daemon->sample);
+    if (error) {
+        /* the process has exited, the next check handles that */
+        LOG_DBG("failed to sample \"%s\" with pid %d: %d (%s)", daemon->name, (int)daemon->pid, error, strerror(error));
+        ovs_close_proc(daemon);
+        return;
+    }
+
+    metric_set(daemon->rss, (long)daemon->sample.rss);
+    metric_set(daemon->pss, (long)daemon->sample.pss);
+    metric_set(daemon->cpu_time, (long)(daemon->sample.cpu_time / 1000));
+    metric_set(daemon->threads, daemon->sample.threads);
+    metric_set(daemon->fds, daemon->sample.fds);
+
+    ovs_check_growth(daemon);
+
+    if (daemon->busy_groups.count > 0 || daemon->stuck_groups.count > 0) {
+        error = proc_sample_threads(&daemon->proc, &daemon->proc_threads, get_conf()->busy_percent);
+        if (error) {
+            LOG_DBG("failed to sample threads of \"%s\" with pid %d: %d (%s)", daemon->name, (int)daemon->pid, error, strerror(error));
+            ovs_close_proc(daemon);
+            return;
+        }
+
+        ovs_check_busy(daemon);
+        ovs_check_stuck(daemon);
+    }
+
+    if (daemon->probe_fd != -1 || wheel_timer_is_pending(&daemon->deadline)) {
+        return;
+    }
+
+    if (daemon->is_busy && (daemon->busy_action == EA_RESTART || daemon->busy_action == EA_COMMAND || daemon->busy_action == EA_REBOOT)) {
+        ovs_stop_daemon(daemon, daemon->pid, "busy loop");
+        chandler_log_incident();
+        return;
+    }
+
+    if (!daemon->is_restart_planned) {
+        return;
+    }
+
+    in_window = time_in_window(get_conf()->maintenance_window);
+    if (in_window < 0) {
+        LOG_ERROR("invalid maintenance_window \"%s\" - planned restart of \"%s\" is postponed", get_conf()->maintenance_window, daemon->name);
+        return;
+    }
+
+    if (in_window) {
+        LOG_INFO("restarting \"%s\" as planned", daemon->name);
+        daemon->is_planned_stop = ovs_stop_daemon(daemon, daemon->pid, "planned restart") >= 0;
+        chandler_log_incident();
+    }
+}
+
+void ovs_sample(void)
+{
+    for (long i = 0; i < g_daemons_count; ++i) {
+        ovs_sample_daemon(&g_daemons[g_order[i]]);
+    }
+}
+
+/* Parses the list of thread name prefixes and registers a metric for every group */
+static void ovs_bind_thread_groups(const ovs_daemon_t * daemon, thread_groups_t * groups, const char * spec, const char * name, const char * help)
+{
+    const char     *p = spec;
+    size_t          length;
+    char            label[MAX_APP_NAME_SIZE + PROC_COMM_SIZE + 1];
+    thread_group_t *group;
+
+    for (size_t i = 0; i < groups->count; ++i) {
+        metric_set(groups->groups[i].metric, 0);
+    }
+
+    groups->count = 0;
+
+    for (p += strspn(p, ", "); *p != '\0' && groups->count < MAX_THREAD_GROUPS; p += strspn(p, ", ")) {
+        length = strcspn(p, ", ");
+        group  = &groups->groups[groups->count++];
+
+        snprintf(group->prefix, sizeof(group->prefix), "%.*s", (int)length, p);
+        snprintf(label, sizeof(label), "%s/%s", daemon->name, group->prefix);
+        group->metric = metric_register(MT_GAUGE, name, help, "threads", label);
+        p += length;
+    }
+}
+
+static void ovs_bind_threads(ovs_daemon_t * daemon)
+{
+    escalation_step_t steps[MAX_ESCALATION_STEPS];
+    size_t            count;
+
+    ovs_bind_thread_groups(daemon, &daemon->busy_groups, daemon->conf->busy_threads,
+        "chandler_busy_threads", "Number of threads saturated for busy_window");
+    ovs_bind_thread_groups(daemon, &daemon->stuck_groups, daemon->conf->stuck_threads,
+        "chandler_stuck_threads", "Number of threads without progress for stuck_timeout");
+
+    daemon->busy_action = -1;
+
+    if (daemon->conf->busy_action[0] == '\0') {
+        return;
+    }
+
+    if (escalation_parse(daemon->conf->busy_action, steps, &count) != 0 || count != 1) {
+        LOG_ERROR("invalid busy_action \"%s\" of service \"%s\" - busy loops are only reported", daemon->conf->busy_action, daemon->name);
+        return;
+    }
+
+    daemon->busy_action = steps[0].action;
+}
+
+/* Binds the entry to the service, runtime state is reset if the entry has served another service */
+static void ovs_daemon_bind(ovs_daemon_t * daemon, const service_conf_t * conf)
+{
+    if (daemon->conf == NULL || 0 != strcmp(daemon->name, conf->name)) {
+        if (daemon->conf != NULL) {
+            ovs_cancel_check(daemon);
+            ovs_forget_child(daemon);
+            cgroup_close(&daemon->cgroup);
+            ovs_close_proc(daemon);
+        }
+
+        memset(daemon, 0, sizeof(*daemon));
+        daemon->probe_fd = -1;
+        daemon->stop_fd  = -1;
+        daemon->output_fd = -1;
+        strcpy(daemon->name, conf->name);
+        ovs_daemon_init(daemon, daemon->name);
+    }
+
+    daemon->conf    = conf;
+    daemon->target  = conf->ctl[0] != '\0'? conf->ctl: conf->name;
+    daemon->pidfile = conf->pidfile;
+    daemon->cmd     = conf->command;
+
+    policy_parse(conf, &daemon->policy);
+    ovs_bind_cgroup(daemon);
+    ovs_bind_threads(daemon);
+}
+
+static long ovs_find_service(const char * name, size_t name_size)
+{
+    for (long i = 0; i < g_daemons_count; ++i) {
+        if (strlen(g_daemons[i].name) == name_size && 0 == strncmp(g_daemons[i].name, name, name_size)) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+static void ovs_resolve_deps(ovs_daemon_t * daemon)
+{
+    const char *p = daemon->conf->depends_on;
+    size_t      length;
+    long        index;
+
+    daemon->deps_count = 0;
+
+    for (p += strspn(p, ", "); *p != '\0'; p += strspn(p, ", ")) {
+        length = strcspn(p, ", ");
+        index = ovs_find_service(p, length);
+
+        if (index < 0) {
+            LOG_ERROR("service \"%s\" depends on unknown service \"%.*s\"", daemon->name, (int)length, p);
+        }
+        else if (daemon->deps_count < MAX_SERVICES) {
+            daemon->deps[daemon->deps_count++] = index;
+        }
+
+        p += length;
+    }
+}
+
+/* Orders services so that each one follows its dependencies, a cycle is broken in configuration order */
+static void ovs_sort_services(void)
+{
+    int    is_placed[MAX_SERVICES] = {0};
+    long   count = 0;
+    int    is_ready;
+
+    while (count < g_daemons_count) {
+        long placed = count;
+
+        for (long i = 0; i < g_daemons_count; ++i) {
+            if (is_placed[i]) {
+                continue;
+            }
+
+            is_ready = 1;
+            for (size_t d = 0; d < g_daemons[i].deps_count; ++d) {
+                is_ready = is_ready && is_placed[g_daemons[i].deps[d]];
+            }
+
+            if (is_ready) {
+                is_placed[i] = 1;
+                g_order[count++] = i;
+            }
+        }
+
+        if (placed == count) {
+            for (long i = 0; i < g_daemons_count; ++i) {
+                if (!is_placed[i]) {
+                    LOG_ERROR("service \"%s\" is in a dependency cycle", g_daemons[i].name);
+                    is_placed[i] = 1;
+                    g_order[count++] = i;
+                    break;
+                }
+            }
+        }
+    }
+}
+
+/* Rebinds the runtime state when the service table has been changed by a reload */
+static void ovs_sync_services(void)
+{
+    const chandler_conf_t *conf = get_conf();
+
+    if (   g_daemons_count == conf->services_count
+        && 0 == memcmp(g_services, conf->services, sizeof(g_services))
+        && 0 == strcmp(g_cgroup_root, conf->cgroup_root)
+    )
+    {
+        return;
+    }
+
+    for (long i = conf->services_count; i < g_daemons_count; ++i) {
+        ovs_cancel_check(&g_daemons[i]);
+        ovs_forget_child(&g_daemons[i]);
+        cgroup_close(&g_daemons[i].cgroup);
+        ovs_close_proc(&g_daemons[i]);
+    }
+
+    memcpy(g_services, conf->services, sizeof(g_services));
+    strcpy(g_cgroup_root, conf->cgroup_root);
+    g_daemons_count = conf->services_count;
+
+    for (long i = 0; i < g_daemons_count; ++i) {
+        ovs_daemon_bind(&g_daemons[i], &conf->services[i]);
+    }
+
+    for (long i = 0; i < g_daemons_count; ++i) {
+        ovs_resolve_deps(&g_daemons[i]);
+    }
+
+    ovs_sort_services();
+}
+
+/* Starts the check of the daemon unless the previous one is still in progress */
+static void ovs_check_daemon(ovs_daemon_t * daemon)
+{
+    if (daemon->probe_fd != -1 || wheel_timer_is_pending(&daemon->deadline)) {
+        LOG_DBG("check of \"%s\" is still in progress", daemon->name);
+        return;
+    }
+
+    if (daemon->is_waiting || daemon->spawn_time) {
+        LOG_DBG("\"%s\" is starting", daemon->name);
+        return;
+    }
+
+    if (g_is_restarting_all) {
+        LOG_DBG("\"%s\" waits for all services to stop", daemon->name);
+        return;
+    }
+
+    daemon->retries_left = get_conf()->request_retries;
+
+    if (daemon->retries_left <= 0)
+        daemon->retries_left = 1;
+
+    /* stuck threads found by the latest sample of the current process */
+    if (daemon->stuck_count > 0 && daemon->proc.pid == daemon->pid) {
+        LOG_ERROR("process \"%s\" has stuck threads: %s", daemon->target, daemon->stuck_detail);
+        ovs_handle_status(daemon, DS_STUCK);
+        return;
+    }
+
+    ovs_get_daemon_status(daemon);
+}
+
+static int ovs_format_daemon_status(char * buffer, size_t size, const ovs_daemon_t * daemon, uint64_t now)
+{
+    if (daemon->check_time == 0) {
+        return snprintf(buffer, size, "%s: not checked yet\n", daemon->name);
+    }
+
+    return snprintf(buffer, size, "%s: %s, pid %d, checked %lu ms ago, last rtt %lu us, rss %lu kB, pss %lu kB%s%s%s%s%s\n",
+        daemon->name,
+        ovs_status_name(daemon->status),
+        (int)daemon->pid,
+        (unsigned long)((now - daemon->check_time) / 1000),
+        (unsigned long)daemon->rtt,
+        (unsigned long)daemon->sample.rss,
+        (unsigned long)daemon->sample.pss,
+        daemon->is_restart_planned? ", restart planned": "",
+        daemon->is_busy? ", busy: ": "",
+        daemon->is_busy? daemon->busy_detail: "",
+        daemon->stuck_count? ", stuck: ": "",
+        daemon->stuck_count? daemon->stuck_detail: "");
+}
+
+long ovs_planned_restarts(void)
+{
+    return g_planned_restarts;
+}
+
+int ovs_format_status(char * buffer, size_t size)
+{
+    uint64_t now = time_monotonic_usec();
+    int      total = 0;
+    int      count;
+
+    for (long i = 0; i < g_daemons_count; ++i) {
+        count = ovs_format_daemon_status(buffer + total, size - total, &g_daemons[g_order[i]], now);
+        if (count < 0 || (size_t)(total + count) >= size) {
+            return count < 0? count: total + count;
+        }
+        total += count;
+    }
+
+    return total;
+}
+
+static int ovs_is_daemon_healthy(const ovs_daemon_t * daemon)
+{
+    /* retries are scheduled only after failed probes, so they can't be pending for alive daemon */
+    return daemon->check_time != 0 && ovs_is_daemon_ready(daemon);
+}
+
+int ovs_is_healthy(void)
+{
+    for (long i = 0; i < g_daemons_count; ++i) {
+        if (!ovs_is_daemon_healthy(&g_daemons[i])) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+void ovs_set_handlers(const ovs_handlers_t * handlers)
+{
+    g_handlers = handlers;
+}
+
+void ovs_check_slow(rtt_window_t * rtts, const char * target)
+{
+    char         detail[128];
+    rtt_trend_t  trend;
+
+    trend = rtt_check_slow(rtts, (uint64_t)get_conf()->slow_ewma * 1000, get_conf()->rtt_percentile, (uint64_t)get_conf()->slow_percentile * 1000);
+    if (trend == RTT_STEADY || g_handlers == NULL) {
+        return;
+    }
+
+    snprintf(detail, sizeof(detail), "rtt ewma %lu us, p%ld %lu us",
+        (unsigned long)rtt_ewma(rtts), get_conf()->rtt_percentile, (unsigned long)rtt_percentile(rtts, get_conf()->rtt_percentile));
+
+    g_handlers->on_slow(target, trend == RTT_SLOWED_DOWN, detail);
+}
+
+void check_ovs(void)
+{
+    ovs_sync_services();
+
+    /* probes of all services run in parallel, results arrive in any order */
+    for (long i = 0; i < g_daemons_count; ++i) {
+        ovs_check_daemon(&g_daemons[g_order[i]]);
+    }
 }
@@ -20,6 +20,51 @@
 #ifndef DWK_OVS_H
 #define DWK_OVS_H
 
+#include "chandler_escalation.h"
+#include "chandler_rtt.h"
+
+#include <stddef.h>
+#include <sys/types.h>
+
+/* Notifications implemented by the main loop */
+typedef struct ovs_handlers_t {
+    void (* on_anomaly)(void);                                   // a check has found a daemon not alive or to be restarted
+    void (* on_slow)(const char * target, int is_slow, const char * detail);  // RTTs of a daemon have crossed slow thresholds
+    void (* on_escalation)(escalation_action_t action);          // recovery has escalated to an action the ovs module can't take, the daemon is restarted as well
+} ovs_handlers_t;
+
+/* Starts checks of both daemons, results are handled from the event loop */
 void check_ovs(void);
 
+/* Sets handlers of check results */
+void ovs_set_handlers(const ovs_handlers_t * handlers);
+
+/*
+ * Checks RTTs against slow_ewma and slow_percentile thresholds and calls
+ * on_slow handler on transitions. Used for probes and ovsdb monitor echoes.
+ */
+void ovs_check_slow(rtt_window_t * rtts, const char * target);
+
+/*
+ * Handles exit of a daemon run as a child of chandler (supervise = 1), status
+ * is the one returned by waitpid(). Returns 1 if the pid belongs to a daemon.
+ */
+int  ovs_on_child_exit(pid_t pid, int status);
+
+/*
+ * Samples resource usage of alive daemons from their /proc files and
+ * restarts the ones whose memory has grown over pss_growth, within
+ * maintenance_window if it is set.
+ */
+void ovs_sample(void);
+
+/* Returns 1 if the last checks have found both daemons alive and ready */
+int  ovs_is_healthy(void);
+
+/* Returns number of relaunches since start which followed planned restarts on pss_growth */
+long ovs_planned_restarts(void);
+
+/* Writes results of the last checks to buffer (no probes are made), returns value like snprintf() */
+int  ovs_format_status(char * buffer, size_t size);
+
 #endif  /* DWK_OVS_H */
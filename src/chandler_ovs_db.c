@@ -22,16 +22,26 @@
 #include "chandler_conf.h"
 #include "chandler_jrpc.h"
 #include "chandler_log.h"
+#include "chandler_metrics.h"
 
 #include <errno.h>
 #include <stddef.h>
 #include <string.h>
 #include <sys/socket.h>
-#include <sys/time.h>
 #include <sys/types.h>
 #include <unistd.h>
 
 
+static metric_t *g_message_size = NULL;
+static metric_t *g_parse_time   = NULL;
+
+#define MONITOR_REQUEST_ID  0
+#define ECHO_REQUEST_ID     1
+
+static char rpc_request_echo[]  = "{\"id\":1,\"method\":\"echo\",\"params\":[]}";
+/* ovsdb-server sends echo requests with "echo" id and expects the params back */
+static char rpc_response_echo[] = "{\"id\":\"echo\",\"result\":[],\"error\":null}";
+
 static char rpc_request_monitor[] = "{\"id\":0,\"method\":\"monitor\",\"params\":[\"Open_vSwitch\",null,{\"Controller\":[{\"columns\":[\"is_connected\"]}]}]}";
 /* response sample:
  * {
@@ -121,15 +131,42 @@ static void handle_changes(struct ovsdb_monitor_t * monitor, jsmntok_t * t, int
     }
 }
 
-static void handle_notifications(struct ovsdb_monitor_t * monitor)
+static int parse_message(ovsdb_message_parser_t * parser, char * str)
+{
+    uint64_t start_time = time_monotonic_usec();
+
+    if (!parse_jrpc(parser, str)) {
+        return 0;
+    }
+
+    metric_observe(g_parse_time, time_monotonic_usec() - start_time);
+    metric_observe(g_message_size, parser->end - str);
+    return 1;
+}
+
+static query_status_t send_message(ovsdb_monitor_t * monitor, const char * message, size_t size)
+{
+    ssize_t count = send(monitor->fd, message, size, MSG_DONTWAIT | MSG_NOSIGNAL);
+
+    if (count != (ssize_t)size) {
+        LOG_ERROR("failed to send a request: %s", message);
+        return QS_SOCKET_ERROR;
+    }
+
+    LOG_DBG("sent a request: %s", message);
+    return QS_SUCCESS;
+}
+
+static query_status_t handle_notifications(struct ovsdb_monitor_t * monitor)
 {
     ovsdb_message_parser_t  parser;
+    query_status_t          status = QS_SUCCESS;
     int                     i;
     jsmntok_t              *t;
 
     LOG_DBG("monitor.buffer.size: %zd", monitor->size);
 
-    while (monitor->size > 0 && parse_jrpc(&parser, monitor->buffer))
+    while (status == QS_SUCCESS && monitor->size > 0 && parse_message(&parser, monitor->buffer))
     {
         if (parser.id == ID_NULL && parser.message_type == OVSDBMT_METHOD_UPDATE) {
             /* handle notification */
@@ -144,24 +181,43 @@ static void handle_notifications(struct ovsdb_monitor_t * monitor)
                 }
             }
         }
+        else if (parser.id == MONITOR_REQUEST_ID && parser.message_type == OVSDBMT_RESPONSE && !monitor->is_subscribed) {
+            if (parser.result >= 0) {
+                LOG_DBG("  result: %s", monitor->buffer + parser.t[parser.result].start);
+                monitor->is_subscribed = 1;
+                handle_changes(monitor, parser.t + parser.result, parser.count - parser.result);
+            }
+            else {
+                LOG_ERROR("ovsdb monitor request has failed");
+                status = QS_RETURNED_ERROR;
+            }
+        }
+        else if (parser.id == ECHO_REQUEST_ID && parser.message_type == OVSDBMT_RESPONSE) {
+            monitor->is_echo_pending = 0;
+            rtt_add(&monitor->rtts, time_monotonic_usec() - monitor->echo_time);
+        }
+        else if (parser.method >= 0 && is_json_token_equal_to_str(monitor->buffer, &parser.t[parser.method], "echo")) {
+            status = send_message(monitor, rpc_response_echo, sizeof(rpc_response_echo) - 1);
+        }
 
         monitor->size -= (parser.end - monitor->buffer);
         memmove(monitor->buffer, parser.end, monitor->size + 1);
 
         LOG_DBG("monitor.buffer.size: %zd", monitor->size);
     }
+
+    return status;
 }
 
 static query_status_t  on_read(struct ovsdb_monitor_t * monitor)
 {
-    ssize_t count = recv(monitor->fd, monitor->buffer + monitor->size, sizeof(monitor->buffer) - monitor->size - 1, 0);
+    ssize_t count = recv(monitor->fd, monitor->buffer + monitor->size, sizeof(monitor->buffer) - monitor->size - 1, MSG_DONTWAIT);
 
     if (count < 0) {
-        /* for timeout -1 is returned with errno set to EAGAIN or EWOULDBLOCK */
         LOG_DBG("recv failed: %d (%s)", errno, strerror(errno));
 
-        if (errno == EAGAIN) {
-            return QS_RECEIVE_TIMEOUT;
+        if (errno == EAGAIN || errno == EINTR) {
+            return QS_SUCCESS;
         }
 
         return QS_SOCKET_ERROR;
@@ -177,7 +233,9 @@ static query_status_t  on_read(struct ovsdb_monitor_t * monitor)
 
     monitor->buffer[monitor->size] = '\0';
 
-    handle_notifications(monitor);
+    if (handle_notifications(monitor) != QS_SUCCESS) {
+        return QS_PROTOCOL_ERROR;
+    }
 
     if ((ssize_t)sizeof(monitor->buffer) - 1 == monitor->size) {
         /* no space left to receive data */
@@ -189,21 +247,24 @@ static query_status_t  on_read(struct ovsdb_monitor_t * monitor)
 
 query_status_t monitor_create(const char * sock_path, ovsdb_monitor_t * monitor, ovsdb_disconnect_handler_t on_disconnect)
 {
-    struct timeval         tv = {.tv_sec = get_conf()->receive_timeout / 1000, .tv_usec = 1000*(get_conf()->receive_timeout % 1000)};
-    int                    fd;
-    ssize_t                count;
-    ssize_t                total = 0;
-    int                    error;
-    query_status_t         status = QS_SUCCESS;
-    ovsdb_message_parser_t parser;
+    int            fd;
+    int            error;
+    query_status_t status;
+
+    if (g_message_size == NULL) {
+        g_message_size = metric_register(MT_HISTOGRAM, "chandler_monitor_message_bytes", "Size of messages received from ovsdb monitor", NULL, NULL);
+        g_parse_time   = metric_register(MT_HISTOGRAM, "chandler_monitor_parse_usec", "Time spent to parse a message received from ovsdb monitor", NULL, NULL);
+    }
 
     monitor->fd = -1;
     monitor->size = 0;
+    monitor->is_subscribed = 0;
+    monitor->is_echo_pending = 0;
     monitor->on_read = on_read;
     monitor->on_disconnect = on_disconnect;
 
     /* connect */
-    error = connect_unix_socket(SOCK_STREAM, sock_path, &fd);
+    error = connect_unix_socket(SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, sock_path, &fd);
     if (error)
     {
         LOG_ERROR("failed to connect to unix socket %s: %d", sock_path, error);
@@ -213,108 +274,35 @@ query_status_t monitor_create(const char * sock_path, ovsdb_monitor_t * monitor,
         case ENETUNREACH:
         case ECONNREFUSED:
         case EADDRNOTAVAIL:
+        case EAGAIN:
             return QS_NO_CONNECTION;
         default:
             return QS_SOCKET_ERROR;
         }
     }
 
-    if (setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv))) {
-        LOG_ERROR("failed to set SO_RCVTIMEO: %d (%s)", errno, strerror(errno));
-        close(fd);
-        return QS_SOCKET_ERROR;
-    }
+    monitor->fd = fd;
 
-    /* request/response */
-    count = send(fd, rpc_request_monitor, sizeof(rpc_request_monitor) - 1, 0);
-    if (count != sizeof(rpc_request_monitor) - 1)
-    {
-        LOG_ERROR("failed to send a request: %s", rpc_request_monitor);
+    /* the response is handled by on_read() like notifications are */
+    status = send_message(monitor, rpc_request_monitor, sizeof(rpc_request_monitor) - 1);
+    if (status != QS_SUCCESS) {
         close(fd);
-        return QS_SOCKET_ERROR;
+        monitor->fd = -1;
     }
 
-    LOG_DBG("sent a request: %s", rpc_request_monitor);
-
-    for (;;)
-    {
-        count = recv(fd, monitor->buffer + total, sizeof(monitor->buffer) - total - 1, 0);
-        if (count < 0) {
-            /* for timeout -1 is returned with errno set to EAGAIN or EWOULDBLOCK */
-            switch (errno)
-            {
-            case EAGAIN:
-                status = QS_RECEIVE_TIMEOUT;
-                break;
-            default:
-                status = QS_SOCKET_ERROR;
-            }
-
-            LOG_DBG("recv failed: %d (%s)", errno, strerror(errno));
-            break;
-        }
-
-        if (count == 0) {
-            status = QS_RECEIVE_TIMEOUT;
-            LOG_DBG("connection closed");
-            break;
-        }
-
-        LOG_DBG("received %zd bytes", count);
-        total += count;
-
-        monitor->buffer[total] = '\0';
-        if (parse_jrpc(&parser, monitor->buffer)) {
-            if (parser.id == 0 && parser.message_type == OVSDBMT_RESPONSE)
-            {
-                LOG_DBG("received valid JSON in response");
-                LOG_DBG("  id    : %ld", parser.id);
-
-                if (parser.result >= 0) {
-                    LOG_DBG("  result: %s", monitor->buffer + parser.t[parser.result].start);
-                }
-
-                if (parser.error >= 0) {
-                    LOG_DBG("  error : %s", monitor->buffer + parser.t[parser.error].start);
-                }
-
-                /* handle response */
-                if (parser.result >= 0) {
-                    handle_changes(monitor, parser.t + parser.result, parser.count - parser.result);
-                }
-                else if (parser.error >= 0) {
-                    status = QS_RETURNED_ERROR;
-                }
-
-                monitor->size = total - (parser.end - monitor->buffer);
-                memmove(monitor->buffer, parser.end, monitor->size + 1);
-
-                handle_notifications(monitor);
-            }
-            else {
-                status = QS_PROTOCOL_ERROR;
-            }
-            break;
-        }
-
-        if ((ssize_t)sizeof(monitor->buffer) - 1 == total) {
-            /* no space left to receive data */
-            status = QS_SYSTEM_ERROR;
-            break;
-        }
-    }
-
-    LOG_DBG("totally received %zd bytes", total);
+    return status;
+}
 
-    if (status != QS_SUCCESS) {
-        LOG_DBG("failed to receive valid response: %s", monitor->buffer);
-        close(fd);
-    }
-    else {
-        monitor->fd = fd;
+query_status_t monitor_echo(ovsdb_monitor_t * monitor)
+{
+    if (!monitor->is_subscribed || monitor->is_echo_pending) {
+        LOG_WARN("ovsdb monitor has not responded in time");
+        return QS_RECEIVE_TIMEOUT;
     }
 
-    return status;
+    monitor->is_echo_pending = 1;
+    monitor->echo_time = time_monotonic_usec();
+    return send_message(monitor, rpc_request_echo, sizeof(rpc_request_echo) - 1);
 }
 
 void monitor_destroy(ovsdb_monitor_t * monitor)
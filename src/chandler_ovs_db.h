@@ -20,6 +20,7 @@
 #ifndef CHANDLER_OVS_DB_H
 #define CHANDLER_OVS_DB_H
 
+#include "chandler_rtt.h"
 #include "chandler_system.h"
 
 struct ovsdb_monitor_t;
@@ -32,6 +33,10 @@ typedef struct ovsdb_monitor_t {
     int                        fd;
     char                       buffer[MAX_RESPONSE_SIZE];
     size_t                     size;
+    int                        is_subscribed;      // response to the monitor request has been received
+    int                        is_echo_pending;    // echo request has been sent and not answered yet
+    uint64_t                   echo_time;          // time when the last echo request was sent in usec
+    rtt_window_t               rtts;               // RTTs of echo requests
     ovsdb_read_handler_t       on_read;
     ovsdb_disconnect_handler_t on_disconnect;
 } ovsdb_monitor_t;
@@ -39,6 +44,9 @@ typedef struct ovsdb_monitor_t {
 
 query_status_t monitor_create(const char * sock_path, ovsdb_monitor_t * monitor, ovsdb_disconnect_handler_t on_disconnect);
 
+/* Checks that the previous echo has been answered and sends a new one, QS_RECEIVE_TIMEOUT - no answer */
+query_status_t monitor_echo(ovsdb_monitor_t * monitor);
+
 void           monitor_destroy(ovsdb_monitor_t * monitor);
 
 #endif  /* CHANDLER_OVS_DB_H */
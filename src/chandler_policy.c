@@ -0,0 +1,363 @@
+/*
+################################################################################
+#
+#  Copyright 2020-2021 Inango Systems Ltd.
+#
+#  Licensed under the Apache License, Version 2.0 (the "License");
+#  you may not use this file except in compliance with the License.
+#  You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+#  Unless required by applicable law or agreed to in writing, software
+#  distributed under the License is distributed on an "AS IS" BASIS,
+#  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+#  See the License for the specific language governing permissions and
+#  limitations under the License.
+#
+################################################################################
+*/
+#define _GNU_SOURCE
+
+#include "chandler_policy.h"
+
+#include "chandler_log.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sched.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+
+#define IOPRIO_CLASS_SHIFT    13
+#define IOPRIO_WHO_PROCESS    1
+#define OOM_SCORE_ADJ_PATH    "/proc/self/oom_score_adj"
+
+
+typedef struct policy_name_t {
+    const char *name;
+    int         value;
+} policy_name_t;
+
+static const policy_name_t sched_names[] = {
+    {"other", SCHED_OTHER},
+    {"batch", SCHED_BATCH},
+    {"idle",  SCHED_IDLE},
+    {"fifo",  SCHED_FIFO},
+    {"rr",    SCHED_RR},
+    {NULL,    0}
+};
+
+static const policy_name_t ioprio_names[] = {
+    {"rt",    1},
+    {"be",    2},
+    {"idle",  3},
+    {NULL,    0}
+};
+
+
+/* Returns value of the name before ':' or the end of spec, -1 if it is unknown */
+static int find_name(const policy_name_t * names, const char * spec, const char ** rest)
+{
+    size_t size = strcspn(spec, ":");
+
+    *rest = spec + size + (spec[size] == ':');
+
+    for (; names->name != NULL; ++names) {
+        if (strlen(names->name) == size && 0 == strncmp(names->name, spec, size)) {
+            return names->value;
+        }
+    }
+
+    return -1;
+}
+
+static int parse_int(const char * str, long min, long max, int * value)
+{
+    char *end;
+    long  number;
+
+    errno  = 0;
+    number = strtol(str, &end, 10);
+    if (str[0] == '\0' || *end != '\0' || errno != 0 || number < min || number > max) {
+        return -1;
+    }
+
+    *value = (int)number;
+    return 0;
+}
+
+/* "0-3,6" */
+static int parse_cpus(const char * spec, uint64_t * cpus)
+{
+    const char *str = spec;
+    char       *end;
+    long        first;
+    long        last;
+
+    memset(cpus, 0, MAX_POLICY_CPUS / 8);
+
+    while (*str != '\0') {
+        first = strtol(str, &end, 10);
+        last  = first;
+        if (end == str) {
+            return -1;
+        }
+
+        if (*end == '-') {
+            str  = end + 1;
+            last = strtol(str, &end, 10);
+            if (end == str) {
+                return -1;
+            }
+        }
+
+        if (first < 0 || last < first || last >= MAX_POLICY_CPUS || (*end != ',' && *end != '\0')) {
+            return -1;
+        }
+
+        for (long cpu = first; cpu <= last; ++cpu) {
+            cpus[cpu / 64] |= (uint64_t)1 << (cpu % 64);
+        }
+
+        str = end + (*end == ',');
+    }
+
+    return str == spec? -1: 0;
+}
+
+static int parse_sched(const char * spec, spawn_policy_t * policy)
+{
+    const char *priority;
+
+    policy->sched_policy = find_name(sched_names, spec, &priority);
+    if (policy->sched_policy == -1) {
+        return -1;
+    }
+
+    policy->sched_priority = 0;
+    if (priority[0] == '\0') {
+        return policy->sched_policy == SCHED_FIFO || policy->sched_policy == SCHED_RR? -1: 0;
+    }
+
+    if (policy->sched_policy == SCHED_FIFO || policy->sched_policy == SCHED_RR) {
+        return parse_int(priority, sched_get_priority_min(policy->sched_policy), sched_get_priority_max(policy->sched_policy), &policy->sched_priority);
+    }
+
+    return parse_int(priority, -20, 19, &policy->sched_priority);
+}
+
+static int parse_ioprio(const char * spec, spawn_policy_t * policy)
+{
+    const char *level_str;
+    int         class = find_name(ioprio_names, spec, &level_str);
+    int         level = 0;
+
+    if (class == -1 || (level_str[0] != '\0' && parse_int(level_str, 0, 7, &level))) {
+        return -1;
+    }
+
+    policy->ioprio = class << IOPRIO_CLASS_SHIFT | level;
+    return 0;
+}
+
+static int parse_rlimit(const char * spec, uint64_t * limit)
+{
+    char *end;
+
+    if (0 == strcmp(spec, "unlimited")) {
+        *limit = POLICY_UNLIMITED;
+        return 0;
+    }
+
+    errno  = 0;
+    *limit = strtoull(spec, &end, 10);
+    return (spec[0] < '0' || spec[0] > '9' || *end != '\0' || errno != 0)? -1: 0;
+}
+
+/* Sets *is_set if spec is not empty and valid, logs an error if it is invalid */
+static int parse_setting(const service_conf_t * conf, const char * key, const char * spec, int rc, int * is_set)
+{
+    *is_set = 0;
+
+    if (spec[0] == '\0') {
+        return 0;
+    }
+
+    if (rc != 0) {
+        LOG_ERROR("invalid value \"%s\" of \"service.%s.%s\" - ignoring it", spec, conf->name, key);
+        return -1;
+    }
+
+    *is_set = 1;
+    return 0;
+}
+
+int policy_parse(const service_conf_t * conf, spawn_policy_t * policy)
+{
+    static const char * const rlimit_keys[PR_COUNT] = {"rlimit_nofile", "rlimit_core", "rlimit_memlock"};
+
+    const char *rlimit_specs[PR_COUNT] = {conf->rlimit_nofile, conf->rlimit_core, conf->rlimit_memlock};
+    int         rc = 0;
+
+    memset(policy, 0, sizeof(*policy));
+
+    rc |= parse_setting(conf, "cpu_affinity", conf->cpu_affinity,
+                        parse_cpus(conf->cpu_affinity, policy->cpus), &policy->is_cpus_set);
+    rc |= parse_setting(conf, "sched", conf->sched,
+                        parse_sched(conf->sched, policy), &policy->is_sched_set);
+    rc |= parse_setting(conf, "ioprio", conf->ioprio,
+                        parse_ioprio(conf->ioprio, policy), &policy->is_ioprio_set);
+    rc |= parse_setting(conf, "oom_score_adj", conf->oom_score_adj,
+                        parse_int(conf->oom_score_adj, -1000, 1000, &policy->oom_score_adj), &policy->is_oom_score_adj_set);
+
+    for (int i = 0; i < PR_COUNT; ++i) {
+        rc |= parse_setting(conf, rlimit_keys[i], rlimit_specs[i],
+                            parse_rlimit(rlimit_specs[i], &policy->rlimits[i]), &policy->is_rlimit_set[i]);
+    }
+
+    return rc;
+}
+
+/* Appends a failure to the report, failures are separated by "; " */
+static void report_failure(char * report, size_t size, const char * format, ...)
+{
+    size_t  length = strlen(report);
+    va_list args;
+
+    if (length > 0 && length + sizeof("; ") <= size) {
+        memcpy(report + length, "; ", sizeof("; "));
+        length += sizeof("; ") - 1;
+    }
+
+    va_start(args, format);
+    vsnprintf(report + length, size - length, format, args);
+    va_end(args);
+}
+
+static void apply_rlimit(int resource, const char * name, uint64_t value, char * report, size_t size)
+{
+    struct rlimit limit;
+
+    limit.rlim_cur = value == POLICY_UNLIMITED? RLIM_INFINITY: (rlim_t)value;
+    limit.rlim_max = limit.rlim_cur;
+
+    if (setrlimit(resource, &limit) != 0) {
+        report_failure(report, size, "failed to set %s limit: errno = %d", name, errno);
+    }
+}
+
+static void apply_cgroup(const char * dir, char * report, size_t size)
+{
+    char path[MAX_PATH_SIZE + sizeof("/cgroup.procs")];
+    int  fd;
+
+    snprintf(path, sizeof(path), "%s/cgroup.procs", dir);
+
+    fd = open(path, O_WRONLY | O_CLOEXEC);
+    if (fd < 0 || write(fd, "0", 1) != 1) {
+        report_failure(report, size, "failed to move to cgroup %s: errno = %d", dir, errno);
+    }
+
+    if (fd >= 0) {
+        close(fd);
+    }
+}
+
+static void apply_oom_score_adj(int value, char * report, size_t size)
+{
+    char buffer[16];
+    int  fd = open(OOM_SCORE_ADJ_PATH, O_WRONLY | O_CLOEXEC);
+    int  length = snprintf(buffer, sizeof(buffer), "%d", value);
+
+    if (fd < 0 || write(fd, buffer, length) != length) {
+        report_failure(report, size, "failed to set oom_score_adj: errno = %d", errno);
+    }
+
+    if (fd >= 0) {
+        close(fd);
+    }
+}
+
+static void apply_sched(int sched_policy, int priority, char * report, size_t size)
+{
+    struct sched_param param = {.sched_priority = 0};
+    int                is_realtime = sched_policy == SCHED_FIFO || sched_policy == SCHED_RR;
+
+    if (is_realtime) {
+        param.sched_priority = priority;
+    }
+
+    if (sched_setscheduler(0, sched_policy, &param) != 0) {
+        report_failure(report, size, "failed to set scheduling policy %d: errno = %d", sched_policy, errno);
+    }
+
+    if (!is_realtime && setpriority(PRIO_PROCESS, 0, priority) != 0) {
+        report_failure(report, size, "failed to set nice value %d: errno = %d", priority, errno);
+    }
+}
+
+static void apply_cpus(const uint64_t * cpus, char * report, size_t size)
+{
+    cpu_set_t set;
+
+    CPU_ZERO(&set);
+    for (int cpu = 0; cpu < MAX_POLICY_CPUS && cpu < CPU_SETSIZE; ++cpu) {
+        if (cpus[cpu / 64] & ((uint64_t)1 << (cpu % 64))) {
+            CPU_SET(cpu, &set);
+        }
+    }
+
+    if (sched_setaffinity(0, sizeof(set), &set) != 0) {
+        report_failure(report, size, "failed to set CPU affinity: errno = %d", errno);
+    }
+}
+
+void policy_apply(const spawn_policy_t * policy, char * report, size_t size)
+{
+    report[0] = '\0';
+
+    if (policy == NULL) {
+        return;
+    }
+
+    /* "0" stands for the writing process */
+    if (policy->cgroup[0] != '\0') {
+        apply_cgroup(policy->cgroup, report, size);
+    }
+
+    if (policy->is_rlimit_set[PR_NOFILE]) {
+        apply_rlimit(RLIMIT_NOFILE, "NOFILE", policy->rlimits[PR_NOFILE], report, size);
+    }
+
+    if (policy->is_rlimit_set[PR_CORE]) {
+        apply_rlimit(RLIMIT_CORE, "CORE", policy->rlimits[PR_CORE], report, size);
+    }
+
+    if (policy->is_rlimit_set[PR_MEMLOCK]) {
+        apply_rlimit(RLIMIT_MEMLOCK, "MEMLOCK", policy->rlimits[PR_MEMLOCK], report, size);
+    }
+
+    if (policy->is_oom_score_adj_set) {
+        apply_oom_score_adj(policy->oom_score_adj, report, size);
+    }
+
+    if (policy->is_ioprio_set && syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, policy->ioprio) != 0) {
+        report_failure(report, size, "failed to set ioprio: errno = %d", errno);
+    }
+
+    if (policy->is_sched_set) {
+        apply_sched(policy->sched_policy, policy->sched_priority, report, size);
+    }
+
+    if (policy->is_cpus_set) {
+        apply_cpus(policy->cpus, report, size);
+    }
+}
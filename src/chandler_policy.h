@@ -0,0 +1,82 @@
+/*
+################################################################################
+#
+#  Copyright 2020-2021 Inango Systems Ltd.
+#
+#  Licensed under the Apache License, Version 2.0 (the "License");
+#  you may not use this file except in compliance with the License.
+#  You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+#  Unless required by applicable law or agreed to in writing, software
+#  distributed under the License is distributed on an "AS IS" BASIS,
+#  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+#  See the License for the specific language governing permissions and
+#  limitations under the License.
+#
+################################################################################
+*/
+#ifndef CHANDLER_POLICY_H
+#define CHANDLER_POLICY_H
+
+#include "chandler_conf.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define MAX_POLICY_CPUS         256
+#define POLICY_UNLIMITED        UINT64_MAX
+#define MAX_POLICY_REPORT_SIZE  256
+
+/* Limits set by the policy, indexes of spawn_policy_t.rlimits */
+typedef enum policy_rlimit_t {
+    PR_NOFILE,
+    PR_CORE,
+    PR_MEMLOCK,
+    PR_COUNT
+} policy_rlimit_t;
+
+/*
+ * Scheduling and resource policy of a spawned daemon, parsed from the
+ * service configuration. Only the parts with is_set flags are applied,
+ * the rest is inherited from chandler.
+ */
+typedef struct spawn_policy_t {
+    int       is_cpus_set;
+    uint64_t  cpus[MAX_POLICY_CPUS / 64];  // CPU affinity mask
+    int       is_sched_set;
+    int       sched_policy;                 // SCHED_XXX
+    int       sched_priority;               // static priority for fifo and rr, nice value for other policies
+    int       is_ioprio_set;
+    int       ioprio;                       // value for ioprio_set(): class << 13 | level
+    int       is_oom_score_adj_set;
+    int       oom_score_adj;
+    int       is_rlimit_set[PR_COUNT];
+    uint64_t  rlimits[PR_COUNT];            // soft and hard limit (POLICY_UNLIMITED - no limit)
+    char      cgroup[MAX_PATH_SIZE];        // cgroup v2 directory the process is moved to (empty - none)
+} spawn_policy_t;
+
+/**
+ * Parses the policy of the service. Invalid settings are logged and left
+ * unset. The cgroup is set by the caller.
+ *
+ * \param conf         Configuration of the service
+ * \param[out] policy  Parsed policy
+ *
+ * \return             0 - on success, -1 - if some settings are invalid
+ */
+int  policy_parse(const service_conf_t * conf, spawn_policy_t * policy);
+
+/**
+ * Applies the policy to the calling process. Called between fork and exec,
+ * where stderr may already be closed, so failures are collected in the
+ * report, which the launcher passes back to chandler to be logged.
+ *
+ * \param policy       Policy to apply (NULL - none)
+ * \param[out] report  Failures separated by "; " (empty - none)
+ * \param size         Size of the report buffer, MAX_POLICY_REPORT_SIZE is enough
+ */
+void policy_apply(const spawn_policy_t * policy, char * report, size_t size);
+
+#endif  /* CHANDLER_POLICY_H */
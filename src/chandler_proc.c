@@ -0,0 +1,391 @@
+/*
+################################################################################
+#
+#  Copyright 2020-2021 Inango Systems Ltd.
+#
+#  Licensed under the Apache License, Version 2.0 (the "License");
+#  you may not use this file except in compliance with the License.
+#  You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+#  Unless required by applicable law or agreed to in writing, software
+#  distributed under the License is distributed on an "AS IS" BASIS,
+#  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+#  See the License for the specific language governing permissions and
+#  limitations under the License.
+#
+################################################################################
+*/
+#define _GNU_SOURCE
+
+#include "chandler_proc.h"
+
+#include "chandler_system.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+
+#define PROC_STAT_SIZE        1024
+#define PROC_SMAPS_SIZE       2048
+#define PROC_DIRENT_SIZE      4096
+
+/* Indexes of /proc/<pid>/stat fields following "pid (comm) " */
+#define STAT_STATE            0
+#define STAT_UTIME            11
+#define STAT_STIME            12
+#define STAT_THREADS          17
+#define STAT_RSS              21
+
+
+/* Linux dirent64 as returned by getdents64 */
+typedef struct proc_dirent_t {
+    uint64_t        ino;
+    int64_t         off;
+    unsigned short  reclen;
+    unsigned char   type;
+    char            name[];
+} proc_dirent_t;
+
+
+static int proc_open_file(pid_t pid, const char * name, int flags)
+{
+    char path[MAX_PATH_SIZE];
+
+    snprintf(path, sizeof(path), "/proc/%d/%s", (int)pid, name);
+    return open(path, flags | O_CLOEXEC);
+}
+
+int proc_open(proc_files_t * files, pid_t pid)
+{
+    int error;
+
+    proc_close(files);
+
+    files->stat_fd  = proc_open_file(pid, "stat", O_RDONLY);
+    files->smaps_fd = proc_open_file(pid, "smaps_rollup", O_RDONLY);
+    files->fd_dir   = proc_open_file(pid, "fd", O_RDONLY | O_DIRECTORY);
+    files->task_dir = proc_open_file(pid, "task", O_RDONLY | O_DIRECTORY);
+
+    if (files->stat_fd < 0 || files->fd_dir < 0 || files->task_dir < 0) {
+        error = errno;
+        files->pid = pid;
+        proc_close(files);
+        return error;
+    }
+
+    files->pid = pid;
+    return 0;
+}
+
+/* Reads the whole file from the beginning */
+static int proc_read(int fd, char * buffer, size_t size)
+{
+    ssize_t count = pread(fd, buffer, size - 1, 0);
+
+    if (count < 0) {
+        return errno;
+    }
+
+    if (count == 0) {
+        return ESRCH;
+    }
+
+    buffer[count] = '\0';
+    return 0;
+}
+
+/* Parses fields of /proc/<pid>/stat following "pid (comm) " (the state letter is the first one), comm is copied if name is not NULL */
+static int proc_parse_stat(char * buffer, unsigned long * fields, char * name)
+{
+    char *str = strrchr(buffer, ')');
+    char *comm = strchr(buffer, '(');
+
+    /* comm may contain spaces and parentheses, fields start after the last ')' */
+    if (str == NULL || comm == NULL || comm > str) {
+        return EINVAL;
+    }
+
+    if (name != NULL) {
+        snprintf(name, PROC_COMM_SIZE, "%.*s", (int)(str - comm - 1), comm + 1);
+    }
+
+    ++str;
+    for (int i = 0; i <= STAT_RSS; ++i) {
+        while (*str == ' ') {
+            ++str;
+        }
+
+        /* the first field is the state letter */
+        fields[i] = i == 0? (unsigned char)*str: strtoul(str, NULL, 10);
+        str += strcspn(str, " ");
+    }
+
+    return 0;
+}
+
+static uint64_t proc_cpu_time(const unsigned long * fields)
+{
+    static long clock_ticks = 0;
+
+    if (clock_ticks == 0) {
+        clock_ticks = sysconf(_SC_CLK_TCK);
+    }
+
+    return (uint64_t)(fields[STAT_UTIME] + fields[STAT_STIME]) * 1000000 / clock_ticks;
+}
+
+static int proc_read_stat(int fd, proc_sample_t * sample)
+{
+    char          buffer[PROC_STAT_SIZE];
+    unsigned long fields[STAT_RSS + 1];
+    int           error = proc_read(fd, buffer, sizeof(buffer));
+
+    if (error == 0) {
+        error = proc_parse_stat(buffer, fields, NULL);
+    }
+
+    if (error) {
+        return error;
+    }
+
+    sample->cpu_time = proc_cpu_time(fields);
+    sample->threads  = (long)fields[STAT_THREADS];
+    sample->rss      = (uint64_t)fields[STAT_RSS] * (sysconf(_SC_PAGESIZE) / 1024);
+    return 0;
+}
+
+static void proc_read_pss(int fd, proc_sample_t * sample)
+{
+    char  buffer[PROC_SMAPS_SIZE];
+    char *str;
+
+    sample->pss = 0;
+
+    if (fd < 0 || proc_read(fd, buffer, sizeof(buffer)) != 0) {
+        return;
+    }
+
+    str = strstr(buffer, "\nPss:");
+    if (str != NULL) {
+        sample->pss = strtoull(str + sizeof("\nPss:") - 1, NULL, 10);
+    }
+}
+
+static int proc_count_fds(int fd_dir, long * count)
+{
+    char                 buffer[PROC_DIRENT_SIZE] __attribute__((aligned(8)));
+    const proc_dirent_t *dirent;
+    long                 size;
+
+    *count = 0;
+
+    if (lseek(fd_dir, 0, SEEK_SET) != 0) {
+        return errno;
+    }
+
+    while ((size = syscall(SYS_getdents64, fd_dir, buffer, sizeof(buffer))) > 0) {
+        for (long offset = 0; offset < size; offset += dirent->reclen) {
+            dirent = (const proc_dirent_t *)(buffer + offset);
+            *count += dirent->name[0] != '.';
+        }
+    }
+
+    return size < 0? errno: 0;
+}
+
+int proc_sample(const proc_files_t * files, proc_sample_t * sample)
+{
+    int error;
+
+    if (files->pid == 0) {
+        return EBADF;
+    }
+
+    error = proc_read_stat(files->stat_fd, sample);
+    if (error) {
+        return error;
+    }
+
+    proc_read_pss(files->smaps_fd, sample);
+    return proc_count_fds(files->fd_dir, &sample->fds);
+}
+
+/* Updates CPU usage of the thread, returns errno if it has exited */
+static int proc_sample_thread(proc_thread_t * thread, uint64_t now, uint64_t interval, long busy_percent)
+{
+    char          buffer[PROC_STAT_SIZE];
+    unsigned long fields[STAT_RSS + 1];
+    uint64_t      cpu_time;
+    int           error = proc_read(thread->stat_fd, buffer, sizeof(buffer));
+
+    if (error == 0) {
+        error = proc_parse_stat(buffer, fields, thread->name);
+    }
+
+    if (error) {
+        return error;
+    }
+
+    cpu_time      = proc_cpu_time(fields);
+    thread->state = (char)fields[STAT_STATE];
+
+    if (cpu_time != thread->cpu_time || thread->progress_time == 0) {
+        thread->progress_time = now;
+    }
+
+    /* threads which have appeared since the previous sample get usage with the next one */
+    if (interval > 0 && thread->cpu_time != 0) {
+        thread->usage = (long)((cpu_time - thread->cpu_time) * 100 / interval);
+    }
+
+    if (thread->usage < busy_percent) {
+        thread->busy_since = 0;
+    }
+    else if (thread->busy_since == 0) {
+        thread->busy_since = now;
+    }
+
+    thread->cpu_time = cpu_time;
+    return 0;
+}
+
+static proc_thread_t * proc_find_thread(proc_threads_t * threads, pid_t tid)
+{
+    for (size_t i = 0; i < threads->count; ++i) {
+        if (threads->threads[i].tid == tid) {
+            return &threads->threads[i];
+        }
+    }
+
+    return NULL;
+}
+
+static void proc_remove_thread(proc_threads_t * threads, size_t index)
+{
+    close(threads->threads[index].stat_fd);
+    threads->threads[index] = threads->threads[--threads->count];
+}
+
+int proc_sample_threads(const proc_files_t * files, proc_threads_t * threads, long busy_percent)
+{
+    char                 buffer[PROC_DIRENT_SIZE] __attribute__((aligned(8)));
+    char                 path[32];
+    const proc_dirent_t *dirent;
+    proc_thread_t       *thread;
+    int                  is_seen[MAX_PROC_THREADS] = {0};
+    uint64_t             now = time_monotonic_usec();
+    uint64_t             interval = threads->sample_time? now - threads->sample_time: 0;
+    long                 size;
+    pid_t                tid;
+
+    if (files->pid == 0) {
+        return EBADF;
+    }
+
+    if (lseek(files->task_dir, 0, SEEK_SET) != 0) {
+        return errno;
+    }
+
+    while ((size = syscall(SYS_getdents64, files->task_dir, buffer, sizeof(buffer))) > 0) {
+        for (long offset = 0; offset < size; offset += dirent->reclen) {
+            dirent = (const proc_dirent_t *)(buffer + offset);
+            tid    = (pid_t)atoi(dirent->name);
+
+            if (tid <= 0) {
+                continue;
+            }
+
+            thread = proc_find_thread(threads, tid);
+            if (thread == NULL) {
+                if (threads->count == MAX_PROC_THREADS) {
+                    continue;
+                }
+
+                snprintf(path, sizeof(path), "%d/stat", (int)tid);
+                thread = &threads->threads[threads->count];
+                memset(thread, 0, sizeof(*thread));
+                thread->tid     = tid;
+                thread->stat_fd = openat(files->task_dir, path, O_RDONLY | O_CLOEXEC);
+                if (thread->stat_fd < 0) {
+                    continue;
+                }
+                ++threads->count;
+            }
+
+            is_seen[thread - threads->threads] = 1;
+        }
+    }
+
+    if (size < 0) {
+        return errno;
+    }
+
+    /* walking backwards, entries moved into the slots of removed ones have already been sampled */
+    for (size_t i = threads->count; i-- > 0; ) {
+        if (!is_seen[i] || proc_sample_thread(&threads->threads[i], now, interval, busy_percent) != 0) {
+            proc_remove_thread(threads, i);
+        }
+    }
+
+    threads->sample_time = now;
+    return threads->count > 0? 0: ESRCH;
+}
+
+int proc_read_wchan(const proc_files_t * files, pid_t tid, char * wchan, size_t size)
+{
+    char path[32];
+    int  fd;
+    int  error;
+
+    snprintf(path, sizeof(path), "%d/wchan", (int)tid);
+
+    fd = openat(files->task_dir, path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return errno;
+    }
+
+    error = proc_read(fd, wchan, size);
+    close(fd);
+    return error;
+}
+
+void proc_close_threads(proc_threads_t * threads)
+{
+    while (threads->count > 0) {
+        proc_remove_thread(threads, threads->count - 1);
+    }
+
+    threads->sample_time = 0;
+}
+
+void proc_close(proc_files_t * files)
+{
+    if (files->pid == 0) {
+        return;
+    }
+
+    if (files->stat_fd >= 0) {
+        close(files->stat_fd);
+    }
+
+    if (files->smaps_fd >= 0) {
+        close(files->smaps_fd);
+    }
+
+    if (files->fd_dir >= 0) {
+        close(files->fd_dir);
+    }
+
+    if (files->task_dir >= 0) {
+        close(files->task_dir);
+    }
+
+    files->pid = 0;
+}
@@ -0,0 +1,125 @@
+/*
+################################################################################
+#
+#  Copyright 2020-2021 Inango Systems Ltd.
+#
+#  Licensed under the Apache License, Version 2.0 (the "License");
+#  you may not use this file except in compliance with the License.
+#  You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+#  Unless required by applicable law or agreed to in writing, software
+#  distributed under the License is distributed on an "AS IS" BASIS,
+#  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+#  See the License for the specific language governing permissions and
+#  limitations under the License.
+#
+################################################################################
+*/
+#ifndef CHANDLER_PROC_H
+#define CHANDLER_PROC_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#define MAX_PROC_THREADS      256
+#define PROC_COMM_SIZE        16
+
+/* Resource usage of a process */
+typedef struct proc_sample_t {
+    uint64_t rss;                            // resident set size in kB
+    uint64_t pss;                            // proportional set size in kB (0 - smaps_rollup is not available)
+    uint64_t cpu_time;                       // user and system CPU time in usec
+    long     threads;
+    long     fds;                            // number of open file descriptors
+} proc_sample_t;
+
+/*
+ * /proc files of a process. They are opened once and read with pread()
+ * on every sample, so sampling costs no path lookups. The descriptors
+ * refer to the process they were opened for even if its pid is reused.
+ */
+typedef struct proc_files_t {
+    pid_t pid;                               // 0 - files are not open
+    int   stat_fd;                           // /proc/<pid>/stat
+    int   smaps_fd;                          // /proc/<pid>/smaps_rollup (-1 - not available)
+    int   fd_dir;                            // /proc/<pid>/fd
+    int   task_dir;                          // /proc/<pid>/task
+} proc_files_t;
+
+/* CPU usage of a thread, its stat file is kept open while the thread exists */
+typedef struct proc_thread_t {
+    pid_t    tid;
+    int      stat_fd;                        // /proc/<pid>/task/<tid>/stat
+    char     name[PROC_COMM_SIZE];           // thread name (comm)
+    char     state;                          // R, S, D, etc. as in /proc/<pid>/task/<tid>/stat
+    uint64_t cpu_time;                       // user and system CPU time in usec
+    long     usage;                          // CPU usage in percent over the latest interval
+    uint64_t busy_since;                     // monotonic usec since usage has been over the threshold (0 - not busy)
+    uint64_t progress_time;                  // monotonic usec of the latest sample which has found CPU time grown
+} proc_thread_t;
+
+/* Threads of a process, updated by proc_sample_threads() */
+typedef struct proc_threads_t {
+    uint64_t      sample_time;               // monotonic usec of the latest sample (0 - not sampled yet)
+    size_t        count;
+    proc_thread_t threads[MAX_PROC_THREADS];
+} proc_threads_t;
+
+/**
+ * Opens /proc files of the process.
+ *
+ * \param files  Files to open, they are closed first if open
+ * \param pid    Pid of the process
+ *
+ * \return       0 - on success, errno - on failure
+ */
+int  proc_open(proc_files_t * files, pid_t pid);
+
+/**
+ * Reads resource usage of the process.
+ *
+ * \param files        Open files of the process
+ * \param[out] sample  Resource usage
+ *
+ * \return             0 - on success, errno - on failure (ESRCH - the process has exited)
+ */
+int  proc_sample(const proc_files_t * files, proc_sample_t * sample);
+
+/**
+ * Reads CPU usage of every thread of the process. Threads which have
+ * appeared since the previous call are added to the table (up to
+ * MAX_PROC_THREADS of them), the ones which have exited are removed.
+ *
+ * \param files         Open files of the process
+ * \param threads       Thread table, zeroed before the first call for the process
+ * \param busy_percent  Usage threshold busy_since of threads is maintained for
+ *
+ * \return              0 - on success, errno - on failure (ESRCH - the process has exited)
+ */
+int  proc_sample_threads(const proc_files_t * files, proc_threads_t * threads, long busy_percent);
+
+/**
+ * Reads the kernel function the thread is sleeping in.
+ *
+ * \param files       Open files of the process
+ * \param tid         Thread id
+ * \param[out] wchan  Function name, "0" if the thread is running or the name is hidden by the kernel
+ * \param size        Size of wchan buffer
+ *
+ * \return            0 - on success, errno - on failure
+ */
+int  proc_read_wchan(const proc_files_t * files, pid_t tid, char * wchan, size_t size);
+
+/**
+ * Closes stat files of the threads and empties the table.
+ */
+void proc_close_threads(proc_threads_t * threads);
+
+/**
+ * Closes /proc files of the process, does nothing if they are not open.
+ */
+void proc_close(proc_files_t * files);
+
+#endif  /* CHANDLER_PROC_H */
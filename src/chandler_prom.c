@@ -0,0 +1,450 @@
+/*
+################################################################################
+#
+#  Copyright 2020-2021 Inango Systems Ltd.
+#
+#  Licensed under the Apache License, Version 2.0 (the "License");
+#  you may not use this file except in compliance with the License.
+#  You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+#  Unless required by applicable law or agreed to in writing, software
+#  distributed under the License is distributed on an "AS IS" BASIS,
+#  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+#  See the License for the specific language governing permissions and
+#  limitations under the License.
+#
+################################################################################
+*/
+#define _GNU_SOURCE
+
+#include "chandler_prom.h"
+
+#include "chandler_log.h"
+#include "chandler_loop.h"
+#include "chandler_metrics.h"
+#include "chandler_system.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+
+#define PROM_HEADER_SIZE      128
+#define PROM_CONTENT_TYPE     "text/plain; version=0.0.4"
+#define PROM_REQUEST_END      "\r\n\r\n"
+
+
+typedef struct prom_writer_t {
+    char   *buffer;
+    size_t  size;
+    size_t  pos;
+    int     overflow;
+} prom_writer_t;
+
+typedef enum prom_client_state_t {
+    PCS_REQUEST,                   // waiting for the end of HTTP request
+    PCS_RESPONSE                   // sending the response
+} prom_client_state_t;
+
+typedef struct prom_client_t {
+    int                  fd;
+    prom_client_state_t  state;
+    size_t               matched;  // number of matched characters of the request terminator
+    size_t               sent;     // number of bytes of g_prom.response already sent
+} prom_client_t;
+
+typedef struct prom_exporter_t {
+    int            fd;
+    prom_client_t  clients[MAX_PROM_CLIENTS];
+    int            clients_count;
+    size_t         response_size;
+    char          *response;       // points into buffer right before the body
+    char           buffer[PROM_HEADER_SIZE + PROM_BUFFER_SIZE];
+} prom_exporter_t;
+
+
+static prom_exporter_t g_prom = {.fd = -1};
+
+
+/*
+ * Serialization without printf: scrape must not disturb probe timing.
+ */
+static void put_data(prom_writer_t * w, const char * data, size_t size)
+{
+    if (w->overflow || w->pos + size > w->size) {
+        w->overflow = 1;
+        return;
+    }
+
+    memcpy(w->buffer + w->pos, data, size);
+    w->pos += size;
+}
+
+static void put_str(prom_writer_t * w, const char * str)
+{
+    put_data(w, str, strlen(str));
+}
+
+static void put_u64(prom_writer_t * w, uint64_t value)
+{
+    char  digits[20];
+    char *p = digits + sizeof(digits);
+
+    do {
+        *--p = (char)('0' + value % 10);
+        value /= 10;
+    } while (value);
+
+    put_data(w, p, digits + sizeof(digits) - p);
+}
+
+static void put_long(prom_writer_t * w, long value)
+{
+    if (value < 0) {
+        put_data(w, "-", 1);
+        put_u64(w, -(uint64_t)value);
+    }
+    else {
+        put_u64(w, (uint64_t)value);
+    }
+}
+
+static void put_label_value(prom_writer_t * w, const char * value)
+{
+    for (; *value; ++value) {
+        switch (*value)
+        {
+        case '\\':
+            put_data(w, "\\\\", 2);
+            break;
+        case '"':
+            put_data(w, "\\\"", 2);
+            break;
+        case '\n':
+            put_data(w, "\\n", 2);
+            break;
+        default:
+            put_data(w, value, 1);
+        }
+    }
+}
+
+/* Writes "name_suffix{label="value",le="bound"} " */
+static void put_series(prom_writer_t * w, const metric_t * metric, const char * suffix, const char * le)
+{
+    int has_labels = (metric->label_name != NULL || le != NULL);
+
+    put_str(w, metric->name);
+    put_str(w, suffix);
+
+    if (has_labels) {
+        put_data(w, "{", 1);
+    }
+
+    if (metric->label_name != NULL) {
+        put_str(w, metric->label_name);
+        put_data(w, "=\"", 2);
+        put_label_value(w, metric->label_value);
+        put_data(w, "\"", 1);
+        if (le != NULL) {
+            put_data(w, ",", 1);
+        }
+    }
+
+    if (le != NULL) {
+        put_data(w, "le=\"", 4);
+        put_str(w, le);
+        put_data(w, "\"", 1);
+    }
+
+    if (has_labels) {
+        put_data(w, "}", 1);
+    }
+
+    put_data(w, " ", 1);
+}
+
+static void put_histogram(prom_writer_t * w, const metric_t * metric)
+{
+    char     bound[24];
+    uint64_t cumulative = 0;
+
+    for (size_t i = 0; i < METRIC_HISTOGRAM_BUCKETS; ++i) {
+        prom_writer_t bw = {bound, sizeof(bound) - 1, 0, 0};
+
+        put_u64(&bw, metric_bucket_bound(i));
+        bound[bw.pos] = '\0';
+
+        cumulative += metric->histogram.buckets[i];
+        put_series(w, metric, "_bucket", bound);
+        put_u64(w, cumulative);
+        put_data(w, "\n", 1);
+    }
+
+    put_series(w, metric, "_bucket", "+Inf");
+    put_u64(w, metric->histogram.count);
+    put_data(w, "\n", 1);
+
+    put_series(w, metric, "_sum", NULL);
+    put_u64(w, metric->histogram.sum);
+    put_data(w, "\n", 1);
+
+    put_series(w, metric, "_count", NULL);
+    put_u64(w, metric->histogram.count);
+    put_data(w, "\n", 1);
+}
+
+static const char * type_name(metric_type_t type)
+{
+    switch (type)
+    {
+    case MT_COUNTER:
+        return "counter";
+    case MT_GAUGE:
+        return "gauge";
+    default:
+        return "histogram";
+    }
+}
+
+static void put_metrics(prom_writer_t * w)
+{
+    size_t    count = metrics_count();
+    metric_t *metric;
+    size_t    i;
+    size_t    j;
+
+    for (i = 0; i < count; ++i) {
+        metric = metric_at(i);
+
+        /* series of one family are written together when its first one is met */
+        for (j = 0; j < i && strcmp(metric_at(j)->name, metric->name) != 0; ++j) {
+        }
+
+        if (j < i) {
+            continue;
+        }
+
+        put_str(w, "# HELP ");
+        put_str(w, metric->name);
+        put_data(w, " ", 1);
+        put_str(w, metric->help);
+        put_str(w, "\n# TYPE ");
+        put_str(w, metric->name);
+        put_data(w, " ", 1);
+        put_str(w, type_name(metric->type));
+        put_data(w, "\n", 1);
+
+        for (j = i; j < count; ++j) {
+            if (strcmp(metric_at(j)->name, metric->name) != 0) {
+                continue;
+            }
+
+            if (metric->type == MT_HISTOGRAM) {
+                put_histogram(w, metric_at(j));
+            }
+            else {
+                put_series(w, metric_at(j), "", NULL);
+                put_long(w, metric_value(metric_at(j)));
+                put_data(w, "\n", 1);
+            }
+        }
+    }
+}
+
+/* Builds the response right in the preallocated buffer: body first, then the header in front of it */
+static void build_response(void)
+{
+    prom_writer_t body   = {g_prom.buffer + PROM_HEADER_SIZE, PROM_BUFFER_SIZE, 0, 0};
+    char          header[PROM_HEADER_SIZE];
+    prom_writer_t hw     = {header, sizeof(header), 0, 0};
+
+    put_metrics(&body);
+    if (body.overflow) {
+        LOG_ERROR("metrics do not fit into %d bytes - response is truncated", PROM_BUFFER_SIZE);
+    }
+
+    put_str(&hw, "HTTP/1.0 200 OK\r\nContent-Type: " PROM_CONTENT_TYPE "\r\nContent-Length: ");
+    put_u64(&hw, body.pos);
+    put_str(&hw, "\r\n\r\n");
+
+    g_prom.response = g_prom.buffer + PROM_HEADER_SIZE - hw.pos;
+    g_prom.response_size = hw.pos + body.pos;
+    memcpy(g_prom.response, header, hw.pos);
+}
+
+static void client_close(int index)
+{
+    loop_del_fd(g_prom.clients[index].fd);
+    close(g_prom.clients[index].fd);
+
+    g_prom.clients[index] = g_prom.clients[--g_prom.clients_count];
+
+    /* a client slot is free again */
+    if (g_prom.fd != -1 && g_prom.clients_count == MAX_PROM_CLIENTS - 1) {
+        loop_mod_fd(g_prom.fd, EPOLLIN);
+    }
+}
+
+static int is_response_in_progress(void)
+{
+    for (int i = 0; i < g_prom.clients_count; ++i) {
+        if (g_prom.clients[i].state == PCS_RESPONSE) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/* Returns 1 if client has to be closed */
+static int client_send(prom_client_t * client)
+{
+    ssize_t count;
+
+    count = send(client->fd, g_prom.response + client->sent, g_prom.response_size - client->sent, MSG_DONTWAIT | MSG_NOSIGNAL);
+    if (count < 0) {
+        if (errno == EAGAIN || errno == EINTR) {
+            return 0;
+        }
+
+        LOG_DBG("failed to send metrics: %d (%s)", errno, strerror(errno));
+        return 1;
+    }
+
+    client->sent += count;
+    return client->sent == g_prom.response_size;
+}
+
+/* Returns 1 if client has to be closed */
+static int client_receive(prom_client_t * client)
+{
+    static const char request_end[] = PROM_REQUEST_END;
+
+    char    buffer[512];
+    ssize_t count;
+
+    /* request content is not interesting: any request gets metrics */
+    count = recv(client->fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+    if (count < 0) {
+        return errno != EAGAIN && errno != EINTR;
+    }
+
+    if (count == 0) {
+        return 1;
+    }
+
+    for (ssize_t i = 0; i < count && client->matched < sizeof(request_end) - 1; ++i) {
+        if (buffer[i] == request_end[client->matched]) {
+            ++client->matched;
+        }
+        else {
+            client->matched = (buffer[i] == request_end[0]);
+        }
+    }
+
+    if (client->matched < sizeof(request_end) - 1) {
+        return 0;
+    }
+
+    /* response is shared by clients in progress and is rebuilt only when there are none */
+    if (!is_response_in_progress()) {
+        build_response();
+    }
+
+    client->state = PCS_RESPONSE;
+    loop_mod_fd(client->fd, EPOLLOUT);
+    return client_send(client);
+}
+
+static void on_client_event(int fd, uint32_t events, void * ctx)
+{
+    (void)events;
+    (void)ctx;
+
+    for (int i = 0; i < g_prom.clients_count; ++i) {
+        prom_client_t *client = &g_prom.clients[i];
+
+        if (client->fd != fd) {
+            continue;
+        }
+
+        if (client->state == PCS_REQUEST? client_receive(client): client_send(client)) {
+            client_close(i);
+        }
+        break;
+    }
+}
+
+static void on_accept(int listen_fd, uint32_t events, void * ctx)
+{
+    int fd;
+
+    (void)events;
+    (void)ctx;
+
+    fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0) {
+        if (errno != EAGAIN) {
+            LOG_ERROR("failed to accept metrics client: %d (%s)", errno, strerror(errno));
+        }
+        return;
+    }
+
+    if (loop_add_fd(fd, EPOLLIN, on_client_event, NULL) != 0) {
+        close(fd);
+        return;
+    }
+
+    g_prom.clients[g_prom.clients_count].fd      = fd;
+    g_prom.clients[g_prom.clients_count].state   = PCS_REQUEST;
+    g_prom.clients[g_prom.clients_count].matched = 0;
+    g_prom.clients[g_prom.clients_count].sent    = 0;
+    ++g_prom.clients_count;
+
+    /* stop accepting while all client slots are busy */
+    if (g_prom.clients_count == MAX_PROM_CLIENTS) {
+        loop_mod_fd(listen_fd, 0);
+    }
+}
+
+int prom_init(const char * sock_path)
+{
+    int error;
+
+    if (sock_path[0] == '\0') {
+        return 0;
+    }
+
+    error = listen_unix_socket(sock_path, &g_prom.fd);
+    if (error) {
+        g_prom.fd = -1;
+        return error;
+    }
+
+    error = loop_add_fd(g_prom.fd, EPOLLIN, on_accept, NULL);
+    if (error) {
+        close(g_prom.fd);
+        g_prom.fd = -1;
+        return error;
+    }
+
+    LOG_INFO("exporting metrics on \"%s\"", sock_path);
+    return 0;
+}
+
+void prom_done(void)
+{
+    while (g_prom.clients_count) {
+        client_close(0);
+    }
+
+    if (g_prom.fd != -1) {
+        loop_del_fd(g_prom.fd);
+        close(g_prom.fd);
+        g_prom.fd = -1;
+    }
+}
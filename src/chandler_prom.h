@@ -0,0 +1,44 @@
+/*
+################################################################################
+#
+#  Copyright 2020-2021 Inango Systems Ltd.
+#
+#  Licensed under the Apache License, Version 2.0 (the "License");
+#  you may not use this file except in compliance with the License.
+#  You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+#  Unless required by applicable law or agreed to in writing, software
+#  distributed under the License is distributed on an "AS IS" BASIS,
+#  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+#  See the License for the specific language governing permissions and
+#  limitations under the License.
+#
+################################################################################
+*/
+#ifndef CHANDLER_PROM_H
+#define CHANDLER_PROM_H
+
+#define MAX_PROM_CLIENTS      4
+#define PROM_BUFFER_SIZE      65536
+
+/**
+ * Starts listening on the unix socket for metric scrapes.
+ *
+ * Every HTTP request gets an HTTP/1.0 response with all registered metrics
+ * in Prometheus text format, and the connection is closed afterwards.
+ * Descriptors are served by the event loop, so loop_init() goes first.
+ *
+ * \param sock_path  Path of the unix socket (empty string - exporter disabled)
+ *
+ * \return           0 on success or if disabled, errno value - otherwise
+ */
+int  prom_init(const char * sock_path);
+
+/**
+ * Closes the listener and all client connections.
+ */
+void prom_done(void);
+
+#endif  /* CHANDLER_PROM_H */
@@ -0,0 +1,99 @@
+/*
+################################################################################
+#
+#  Copyright 2020-2021 Inango Systems Ltd.
+#
+#  Licensed under the Apache License, Version 2.0 (the "License");
+#  you may not use this file except in compliance with the License.
+#  You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+#  Unless required by applicable law or agreed to in writing, software
+#  distributed under the License is distributed on an "AS IS" BASIS,
+#  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+#  See the License for the specific language governing permissions and
+#  limitations under the License.
+#
+################################################################################
+*/
+#include "chandler_rtt.h"
+
+
+void rtt_add(rtt_window_t * window, uint64_t rtt)
+{
+    if (window->count == 0) {
+        window->ewma = rtt;
+    }
+    else {
+        window->ewma = window->ewma - (window->ewma >> RTT_EWMA_SHIFT) + (rtt >> RTT_EWMA_SHIFT);
+    }
+
+    window->samples[window->next] = rtt;
+    window->next = (window->next + 1) % RTT_WINDOW_SIZE;
+
+    if (window->count < RTT_WINDOW_SIZE) {
+        ++window->count;
+    }
+}
+
+size_t rtt_count(const rtt_window_t * window)
+{
+    return window->count;
+}
+
+uint64_t rtt_ewma(const rtt_window_t * window)
+{
+    return window->ewma;
+}
+
+rtt_trend_t rtt_check_slow(rtt_window_t * window, uint64_t ewma_limit, long percentile, uint64_t percentile_limit)
+{
+    int is_slow;
+
+    if (window->count < RTT_MIN_SAMPLES) {
+        return RTT_STEADY;
+    }
+
+    is_slow = (ewma_limit && window->ewma > ewma_limit)
+           || (percentile_limit && rtt_percentile(window, percentile) > percentile_limit);
+
+    if (is_slow == window->is_slow) {
+        return RTT_STEADY;
+    }
+
+    window->is_slow = is_slow;
+    return is_slow? RTT_SLOWED_DOWN: RTT_RECOVERED;
+}
+
+uint64_t rtt_percentile(const rtt_window_t * window, long percentile)
+{
+    uint64_t sorted[RTT_WINDOW_SIZE];
+    uint64_t value;
+    size_t   rank;
+    size_t   i;
+    size_t   j;
+
+    if (window->count == 0) {
+        return 0;
+    }
+
+    if (percentile < 1) {
+        percentile = 1;
+    }
+    else if (percentile > 100) {
+        percentile = 100;
+    }
+
+    /* insertion sort: the window is small and probes are rare */
+    for (i = 0; i < window->count; ++i) {
+        value = window->samples[i];
+        for (j = i; j > 0 && sorted[j - 1] > value; --j) {
+            sorted[j] = sorted[j - 1];
+        }
+        sorted[j] = value;
+    }
+
+    rank = (window->count * (size_t)percentile + 99) / 100;
+    return sorted[rank - 1];
+}
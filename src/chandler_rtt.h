@@ -0,0 +1,86 @@
+/*
+################################################################################
+#
+#  Copyright 2020-2021 Inango Systems Ltd.
+#
+#  Licensed under the Apache License, Version 2.0 (the "License");
+#  you may not use this file except in compliance with the License.
+#  You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+#  Unless required by applicable law or agreed to in writing, software
+#  distributed under the License is distributed on an "AS IS" BASIS,
+#  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+#  See the License for the specific language governing permissions and
+#  limitations under the License.
+#
+################################################################################
+*/
+#ifndef CHANDLER_RTT_H
+#define CHANDLER_RTT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define RTT_WINDOW_SIZE       64
+#define RTT_MIN_SAMPLES       8
+
+/* EWMA weight of a new sample is 1/2^RTT_EWMA_SHIFT */
+#define RTT_EWMA_SHIFT        3
+
+/* Rolling window of the latest round trip times in usec */
+typedef struct rtt_window_t {
+    uint64_t samples[RTT_WINDOW_SIZE];
+    size_t   count;                    // number of valid samples
+    size_t   next;                     // index of the slot for the next sample
+    uint64_t ewma;                     // exponentially weighted moving average of all samples
+    int      is_slow;                  // thresholds have been exceeded by the last rtt_check_slow()
+} rtt_window_t;
+
+typedef enum rtt_trend_t {
+    RTT_STEADY,                        // state has not changed
+    RTT_SLOWED_DOWN,                   // thresholds are exceeded now
+    RTT_RECOVERED                      // RTTs are back below thresholds
+} rtt_trend_t;
+
+/**
+ * Adds a sample replacing the oldest one when the window is full.
+ */
+void     rtt_add(rtt_window_t * window, uint64_t rtt);
+
+/**
+ * Returns number of samples in the window.
+ */
+size_t   rtt_count(const rtt_window_t * window);
+
+/**
+ * Returns exponentially weighted moving average of samples.
+ */
+uint64_t rtt_ewma(const rtt_window_t * window);
+
+/**
+ * Compares EWMA and percentile of samples with thresholds and reports
+ * transitions between normal and slow state. Nothing is reported until
+ * RTT_MIN_SAMPLES are collected.
+ *
+ * \param window            Window of samples
+ * \param ewma_limit        EWMA threshold in usec (0 - not checked)
+ * \param percentile        Percentile in range 1..100
+ * \param percentile_limit  Percentile threshold in usec (0 - not checked)
+ *
+ * \return                  Transition made by this check
+ */
+rtt_trend_t rtt_check_slow(rtt_window_t * window, uint64_t ewma_limit, long percentile, uint64_t percentile_limit);
+
+/**
+ * Returns the sample at the given percentile (nearest rank method).
+ *
+ * \param window      Window of samples
+ * \param percentile  Percentile in range 1..100
+ *
+ * \return            Sample value, 0 - if the window is empty
+ */
+uint64_t rtt_percentile(const rtt_window_t * window, long percentile);
+
+#endif  /* CHANDLER_RTT_H */
@@ -0,0 +1,345 @@
+/*
+################################################################################
+#
+#  Copyright 2020-2021 Inango Systems Ltd.
+#
+#  Licensed under the Apache License, Version 2.0 (the "License");
+#  you may not use this file except in compliance with the License.
+#  You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+#  Unless required by applicable law or agreed to in writing, software
+#  distributed under the License is distributed on an "AS IS" BASIS,
+#  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+#  See the License for the specific language governing permissions and
+#  limitations under the License.
+#
+################################################################################
+*/
+#define _GNU_SOURCE
+
+#include "chandler_spawner.h"
+
+#include "chandler_log.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+
+typedef struct spawner_t {
+    pid_t pid;                               // pid of the helper (0 - not running)
+    int   fd;                                // chandler's end of the socket pair (-1 - none)
+} spawner_t;
+
+static spawner_t g_spawner = {.pid = 0, .fd = -1};
+
+
+/* Receives a request and the descriptor attached to it (-1 - none) */
+static ssize_t spawner_receive(int fd, spawn_request_t * request, int * output_fd)
+{
+    struct iovec    iov = {.iov_base = request, .iov_len = sizeof(*request)};
+    char            control[CMSG_SPACE(sizeof(int))];
+    struct msghdr   msg = {.msg_iov = &iov, .msg_iovlen = 1, .msg_control = control, .msg_controllen = sizeof(control)};
+    struct cmsghdr *cmsg;
+    ssize_t         count;
+
+    *output_fd = -1;
+
+    count = recvmsg(fd, &msg, MSG_CMSG_CLOEXEC);
+
+    cmsg = count > 0? CMSG_FIRSTHDR(&msg): NULL;
+    if (cmsg != NULL && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+        memcpy(output_fd, CMSG_DATA(cmsg), sizeof(int));
+    }
+
+    return count;
+}
+
+/*
+ * Runs in the launched process. Failures to apply the policy are written to
+ * report_fd, which is closed before exec, so the launcher does not wait for it.
+ */
+static void spawner_exec(const char * command, int output_fd, int is_foreground, const spawn_policy_t * policy, int report_fd)
+{
+    char report[MAX_POLICY_REPORT_SIZE];
+
+    policy_apply(policy, report, sizeof(report));
+
+    if (report[0] != '\0' && report_fd != -1 && write(report_fd, report, strlen(report)) < 0) {
+        /* nowhere else to report it, the process is launched anyway */
+    }
+
+    if (report_fd != -1) {
+        close(report_fd);
+    }
+
+    exec_command(command, output_fd, is_foreground);
+}
+
+/* Reads the report of the launched process until it has closed its end (fd -1 - no report) */
+static void spawner_read_report(int fd, char * report, size_t size)
+{
+    size_t  length = 0;
+    ssize_t count = 0;
+
+    while (fd != -1 && length + 1 < size && (count = read(fd, report + length, size - 1 - length)) != 0) {
+        if (count < 0 && errno != EINTR) {
+            break;
+        }
+        length += count > 0? (size_t)count: 0;
+    }
+
+    report[length] = '\0';
+
+    if (fd != -1) {
+        close(fd);
+    }
+}
+
+/* Main loop of the helper, it exits when chandler closes its end of the socket */
+static void spawner_main(int fd)
+{
+    spawn_request_t  request;
+    spawn_response_t response;
+    sigset_t         mask;
+    int              output_fd;
+    int              report_fds[2];
+
+    /* the helper is stopped by chandler only */
+    sigfillset(&mask);
+    sigprocmask(SIG_SETMASK, &mask, NULL);
+
+    for (int x = (int)sysconf(_SC_OPEN_MAX); x >= 0; --x) {
+        if (x != fd) {
+            close(x);
+        }
+    }
+
+    /* fails without CAP_IPC_LOCK or big enough RLIMIT_MEMLOCK, the helper is still useful then */
+    mlockall(MCL_CURRENT | MCL_FUTURE);
+
+    while (spawner_receive(fd, &request, &output_fd) == (ssize_t)sizeof(request)) {
+        request.command[sizeof(request.command) - 1] = '\0';
+
+        if (pipe2(report_fds, O_CLOEXEC) != 0) {
+            report_fds[0] = report_fds[1] = -1;
+        }
+
+        /* the process becomes a sibling of the helper, i.e. a child of chandler */
+        response.pid   = (pid_t)syscall(SYS_clone, CLONE_PARENT | SIGCHLD, 0, 0, 0, 0);
+        response.error = errno;
+
+        if (response.pid == 0) {
+            close(report_fds[0]);
+            spawner_exec(request.command, output_fd, request.is_foreground, request.has_policy? &request.policy: NULL, report_fds[1]);
+        }
+
+        if (report_fds[1] != -1) {
+            close(report_fds[1]);
+        }
+
+        if (response.pid == -1 && report_fds[0] != -1) {
+            close(report_fds[0]);
+            report_fds[0] = -1;
+        }
+
+        spawner_read_report(report_fds[0], response.report, sizeof(response.report));
+
+        if (output_fd != -1) {
+            close(output_fd);
+        }
+
+        if (send(fd, &response, sizeof(response), MSG_NOSIGNAL) != (ssize_t)sizeof(response)) {
+            break;
+        }
+    }
+
+    _exit(EXIT_SUCCESS);
+}
+
+/* Closes the connection, the helper exits when it notices that */
+static void spawner_close(void)
+{
+    if (g_spawner.fd != -1) {
+        close(g_spawner.fd);
+        g_spawner.fd = -1;
+    }
+}
+
+int spawner_init(void)
+{
+    struct timeval timeout = {.tv_sec = SPAWNER_TIMEOUT_MSEC / 1000, .tv_usec = (SPAWNER_TIMEOUT_MSEC % 1000) * 1000};
+    int            fds[2];
+    int            error;
+
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, fds) != 0) {
+        return errno;
+    }
+
+    g_spawner.pid = fork();
+    if (g_spawner.pid == 0) {
+        spawner_main(fds[1]);
+    }
+
+    error = errno;
+    close(fds[1]);
+
+    if (g_spawner.pid == -1) {
+        g_spawner.pid = 0;
+        close(fds[0]);
+        return error;
+    }
+
+    /* a stuck helper must not block the event loop for long */
+    setsockopt(fds[0], SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fds[0], SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    g_spawner.fd = fds[0];
+    return 0;
+}
+
+/* Asks the helper to launch the command, returns -1 if the helper has failed to respond */
+static pid_t spawner_request(const char * command, int output_fd, int is_foreground, const spawn_policy_t * policy, int * error, char * report)
+{
+    spawn_request_t  request;
+    spawn_response_t response;
+    char             control[CMSG_SPACE(sizeof(int))];
+    struct iovec     iov = {.iov_base = &request, .iov_len = sizeof(request)};
+    struct msghdr    msg = {.msg_iov = &iov, .msg_iovlen = 1};
+    struct cmsghdr  *cmsg;
+
+    memset(&request, 0, sizeof(request));
+    request.is_foreground = is_foreground;
+    if (policy != NULL) {
+        request.has_policy = 1;
+        request.policy     = *policy;
+    }
+    strncpy(request.command, command, sizeof(request.command) - 1);
+
+    if (output_fd != -1) {
+        memset(control, 0, sizeof(control));
+        msg.msg_control    = control;
+        msg.msg_controllen = sizeof(control);
+
+        cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type  = SCM_RIGHTS;
+        cmsg->cmsg_len   = CMSG_LEN(sizeof(int));
+        memcpy(CMSG_DATA(cmsg), &output_fd, sizeof(int));
+    }
+
+    if (   sendmsg(g_spawner.fd, &msg, MSG_NOSIGNAL) != (ssize_t)sizeof(request)
+        || recv(g_spawner.fd, &response, sizeof(response), 0) != (ssize_t)sizeof(response)
+    )
+    {
+        *error = errno;
+        return -1;
+    }
+
+    *error = response.error;
+    response.report[sizeof(response.report) - 1] = '\0';
+    strcpy(report, response.report);
+    return response.pid;
+}
+
+/* Logs failures to apply the policy of the launched process */
+static void spawner_log_report(const char * command, pid_t pid, const char * report)
+{
+    if (report[0] != '\0') {
+        LOG_ERROR("failed to apply policy of \"%s\" with pid %d: %s", command, pid, report);
+    }
+}
+
+pid_t spawner_run(const char * command, int output_fd, int is_foreground, const spawn_policy_t * policy)
+{
+    char  report[MAX_POLICY_REPORT_SIZE];
+    pid_t pid;
+    int   error;
+    int   report_fds[2];
+
+    if (g_spawner.fd == -1 && g_spawner.pid == 0 && spawner_init() == 0) {
+        LOG_INFO("spawn helper has been restarted with pid %d", g_spawner.pid);
+    }
+
+    if (g_spawner.fd != -1) {
+        pid = spawner_request(command, output_fd, is_foreground, policy, &error, report);
+        if (pid > 0) {
+            LOG_DBG("spawn helper has launched a process with pid = %d", pid);
+            spawner_log_report(command, pid, report);
+            return pid;
+        }
+
+        if (error == EAGAIN || error == ENOMEM) {
+            LOG_ERROR("spawn helper has failed to launch a process: %d (%s)", error, strerror(error));
+            errno = error;
+            return -1;
+        }
+
+        /* the helper is stuck or gone, it is restarted once it has exited */
+        LOG_ERROR("spawn helper does not respond: %d (%s) - launching by chandler", error, strerror(error));
+        spawner_close();
+        kill(g_spawner.pid, SIGKILL);
+    }
+
+    if (pipe2(report_fds, O_CLOEXEC) != 0) {
+        LOG_WARN("failed to create pipe for the policy report: errno = %d", errno);
+        report_fds[0] = report_fds[1] = -1;
+    }
+
+    pid = fork();
+    if (pid == 0) {
+        close(report_fds[0]);
+        spawner_exec(command, output_fd, is_foreground, policy, report_fds[1]);
+    }
+
+    error = errno;
+
+    if (report_fds[1] != -1) {
+        close(report_fds[1]);
+    }
+
+    if (pid == -1) {
+        if (report_fds[0] != -1) {
+            close(report_fds[0]);
+        }
+        LOG_ERROR("failed to fork: errno = %d", error);
+        errno = error;
+        return -1;
+    }
+
+    spawner_read_report(report_fds[0], report, sizeof(report));
+
+    LOG_DBG("forked a child process with pid = %d", pid);
+    spawner_log_report(command, pid, report);
+    return pid;
+}
+
+int spawner_on_exit(pid_t pid)
+{
+    if (g_spawner.pid == 0 || g_spawner.pid != pid) {
+        return 0;
+    }
+
+    if (g_spawner.fd != -1) {
+        LOG_ERROR("spawn helper with pid %d has exited unexpectedly", pid);
+    }
+
+    spawner_close();
+    g_spawner.pid = 0;
+    return 1;
+}
+
+void spawner_done(void)
+{
+    spawner_close();
+}
@@ -0,0 +1,86 @@
+/*
+################################################################################
+#
+#  Copyright 2020-2021 Inango Systems Ltd.
+#
+#  Licensed under the Apache License, Version 2.0 (the "License");
+#  you may not use this file except in compliance with the License.
+#  You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+#  Unless required by applicable law or agreed to in writing, software
+#  distributed under the License is distributed on an "AS IS" BASIS,
+#  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+#  See the License for the specific language governing permissions and
+#  limitations under the License.
+#
+################################################################################
+*/
+#ifndef CHANDLER_SPAWNER_H
+#define CHANDLER_SPAWNER_H
+
+#include "chandler_policy.h"
+#include "chandler_system.h"
+
+#include <sys/types.h>
+
+#define SPAWNER_TIMEOUT_MSEC  1000
+
+/*
+ * Daemons are launched by a helper process forked at startup, before the
+ * main process has grown. The helper locks its memory, so it does not have
+ * to be paged in, and it stays small, so its fork is cheap and still
+ * succeeds when the main process can't fork because of memory pressure.
+ * Launched processes are made children of chandler (CLONE_PARENT), so their
+ * exit is still reported to chandler by SIGCHLD.
+ */
+typedef struct spawn_request_t {
+    int             is_foreground;           // see exec_command()
+    int             has_policy;
+    spawn_policy_t  policy;                  // applied between fork and exec
+    char            command[MAX_COMMAND_SIZE];
+} spawn_request_t;
+
+typedef struct spawn_response_t {
+    pid_t pid;                               // pid of the launched process, -1 - on error
+    int   error;                             // errno of the failure
+    char  report[MAX_POLICY_REPORT_SIZE];    // failures to apply the policy, see policy_apply()
+} spawn_response_t;
+
+/**
+ * Forks the helper. Should be called before big allocations are made, all
+ * memory of the main process at this moment is locked in the helper too.
+ *
+ * \return  0 - on success, errno - on failure (daemons are forked by chandler itself)
+ */
+int   spawner_init(void);
+
+/**
+ * Launches the command by the helper, or by fork() of chandler if the
+ * helper is not available.
+ *
+ * \param command        Command line, arguments are separated by spaces
+ * \param output_fd      Descriptor stdout and stderr of the process are redirected to (-1 - none)
+ * \param is_foreground  See exec_command()
+ * \param policy         Scheduling and resource policy of the process (NULL - inherited from chandler)
+ *
+ * \return               Pid of the process, -1 - on error (errno is set)
+ */
+pid_t spawner_run(const char * command, int output_fd, int is_foreground, const spawn_policy_t * policy);
+
+/**
+ * Handles exit of a child process.
+ *
+ * \param pid  Pid returned by waitpid()
+ *
+ * \return     1 if the child was the helper, 0 - otherwise
+ */
+int   spawner_on_exit(pid_t pid);
+
+/**
+ * Stops the helper.
+ */
+void  spawner_done(void);
+
+#endif  /* CHANDLER_SPAWNER_H */
@@ -22,10 +22,35 @@
 static chandler_stat_t g_chandler_stat = {
     .kills_count     = 0,
     .restarts_count  = 0,
-    .failures_count  = 0
+    .failures_count  = 0,
+    .reboots_count   = 0,
+    .boots_count     = 0
 };
 
 chandler_stat_t * chandler_stat(void)
 {
     return &g_chandler_stat;
 }
+
+void stat_window_add(stat_window_t * window, uint64_t now)
+{
+    window->times[window->next] = now;
+    window->next = (window->next + 1) % STAT_WINDOW_SIZE;
+
+    if (window->count < STAT_WINDOW_SIZE) {
+        ++window->count;
+    }
+}
+
+long stat_window_count(const stat_window_t * window, uint64_t now, uint64_t period)
+{
+    long count = 0;
+
+    for (size_t i = 0; i < window->count; ++i) {
+        if (now - window->times[i] <= period) {
+            ++count;
+        }
+    }
+
+    return count;
+}
@@ -20,13 +20,52 @@
 #ifndef CHANDLER_STAT_H
 #define CHANDLER_STAT_H
 
+#include <stddef.h>
+#include <stdint.h>
+
+/* Max number of events remembered by a sliding window */
+#define STAT_WINDOW_SIZE  64
+
+/* Times of the latest events, used to count events within a period */
+typedef struct stat_window_t {
+    uint64_t times[STAT_WINDOW_SIZE];  // wall clock times of events in usec (they are kept across reboots)
+    size_t   count;                    // number of valid entries
+    size_t   next;                     // index of the entry for the next event
+} stat_window_t;
+
+/* Statistics are kept in the state file (see chandler_state.h), so field layout is a part of its format */
 typedef struct chandler_stat_t {
-    long restarts_count;
-    long kills_count;
-    long failures_count;
+    long          restarts_count;
+    long          kills_count;
+    long          failures_count;
+    long          reboots_count;     // number of reboots requested by chandler
+    long          boots_count;       // number of system boots seen by chandler
+    stat_window_t recent_restarts;
+    stat_window_t recent_failures;
+    stat_window_t recent_reboots;
+    stat_window_t recent_boots;
 } chandler_stat_t;
 
 
 chandler_stat_t * chandler_stat(void);
 
+/**
+ * Remembers an event, the oldest one is forgotten when the window is full.
+ *
+ * \param window  Sliding window
+ * \param now     Wall clock time of the event in usec
+ */
+void stat_window_add(stat_window_t * window, uint64_t now);
+
+/**
+ * Counts remembered events which happened within the period.
+ *
+ * \param window  Sliding window
+ * \param now     Current wall clock time in usec
+ * \param period  Length of the period in usec
+ *
+ * \return        Number of events, at most STAT_WINDOW_SIZE
+ */
+long stat_window_count(const stat_window_t * window, uint64_t now, uint64_t period);
+
 #endif  /* CHANDLER_STAT_H */
@@ -0,0 +1,196 @@
+/*
+################################################################################
+#
+#  Copyright 2020-2021 Inango Systems Ltd.
+#
+#  Licensed under the Apache License, Version 2.0 (the "License");
+#  you may not use this file except in compliance with the License.
+#  You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+#  Unless required by applicable law or agreed to in writing, software
+#  distributed under the License is distributed on an "AS IS" BASIS,
+#  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+#  See the License for the specific language governing permissions and
+#  limitations under the License.
+#
+################################################################################
+*/
+#define _GNU_SOURCE
+
+#include "chandler_state.h"
+
+#include "chandler_log.h"
+#include "chandler_stat.h"
+#include "chandler_system.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+static state_file_t *g_state = NULL;
+static state_slot_t *g_current = NULL;        // the newest valid slot
+
+
+static uint32_t crc32(const void * data, size_t size)
+{
+    const uint8_t *p = data;
+    uint32_t       crc = 0xffffffffu;
+
+    while (size--) {
+        crc ^= *p++;
+        for (int i = 0; i < 8; ++i) {
+            crc = (crc >> 1) ^ (0xedb88320u & -(crc & 1));
+        }
+    }
+
+    return ~crc;
+}
+
+static uint32_t slot_crc(const state_slot_t * slot)
+{
+    return crc32(slot, offsetof(state_slot_t, crc));
+}
+
+static int is_slot_valid(const state_slot_t * slot)
+{
+    return slot->seq != 0 && slot->crc == slot_crc(slot);
+}
+
+static void read_boot_id(char * boot_id)
+{
+    FILE *file;
+
+    memset(boot_id, 0, BOOT_ID_SIZE);
+
+    file = fopen(BOOT_ID_PATH, "re");
+    if (file == NULL) {
+        return;
+    }
+
+    if (fgets(boot_id, BOOT_ID_SIZE, file) != NULL) {
+        boot_id[strcspn(boot_id, "\n")] = '\0';
+    }
+
+    fclose(file);
+}
+
+static void state_write(const char * boot_id)
+{
+    state_slot_t *slot = &g_state->slots[0];
+
+    if (g_current == slot) {
+        slot = &g_state->slots[1];
+    }
+
+    slot->seq = (g_current != NULL)? g_current->seq + 1: 1;
+    memcpy(slot->boot_id, boot_id, BOOT_ID_SIZE);
+    slot->stat = *chandler_stat();
+    slot->crc = slot_crc(slot);
+
+    if (msync(g_state, sizeof(*g_state), MS_SYNC) != 0) {
+        LOG_ERROR("failed to sync state file: %d (%s)", errno, strerror(errno));
+    }
+
+    g_current = slot;
+}
+
+int state_open(const char * path)
+{
+    struct stat  st;
+    char         boot_id[BOOT_ID_SIZE];
+    void        *map;
+    int          fd;
+    int          error;
+
+    if (path[0] == '\0') {
+        return 0;
+    }
+
+    fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        error = errno;
+        LOG_ERROR("failed to open state file \"%s\": %d (%s)", path, error, strerror(error));
+        if (fd >= 0) {
+            close(fd);
+        }
+        return error;
+    }
+
+    if ((size_t)st.st_size != sizeof(state_file_t) && ftruncate(fd, sizeof(state_file_t)) != 0) {
+        error = errno;
+        LOG_ERROR("failed to resize state file \"%s\": %d (%s)", path, error, strerror(error));
+        close(fd);
+        return error;
+    }
+
+    map = mmap(NULL, sizeof(state_file_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    error = errno;
+    close(fd);
+
+    if (map == MAP_FAILED) {
+        LOG_ERROR("failed to map state file \"%s\": %d (%s)", path, error, strerror(error));
+        return error;
+    }
+
+    g_state = map;
+    g_current = NULL;
+
+    if (g_state->magic != STATE_MAGIC || g_state->version != STATE_VERSION || g_state->slot_size != sizeof(state_slot_t)) {
+        LOG_WARN("state file \"%s\" is empty or has unknown format - resetting", path);
+        memset(g_state, 0, sizeof(*g_state));
+        g_state->magic     = STATE_MAGIC;
+        g_state->version   = STATE_VERSION;
+        g_state->slot_size = sizeof(state_slot_t);
+    }
+
+    for (int i = 0; i < 2; ++i) {
+        if (is_slot_valid(&g_state->slots[i]) && (g_current == NULL || g_state->slots[i].seq > g_current->seq)) {
+            g_current = &g_state->slots[i];
+        }
+    }
+
+    if (g_current != NULL) {
+        *chandler_stat() = g_current->stat;
+    }
+
+    read_boot_id(boot_id);
+    if (g_current == NULL || strncmp(boot_id, g_current->boot_id, BOOT_ID_SIZE) != 0) {
+        chandler_stat()->boots_count += 1;
+        stat_window_add(&chandler_stat()->recent_boots, time_realtime_usec());
+    }
+
+    state_write(boot_id);
+
+    LOG_INFO("loaded state from \"%s\": %ld boots, %ld reboots, %ld restarts",
+        path, chandler_stat()->boots_count, chandler_stat()->reboots_count, chandler_stat()->restarts_count);
+    return 0;
+}
+
+void state_update(void)
+{
+    if (g_state == NULL || 0 == memcmp(&g_current->stat, chandler_stat(), sizeof(chandler_stat_t))) {
+        return;
+    }
+
+    state_write(g_current->boot_id);
+}
+
+void state_close(void)
+{
+    if (g_state == NULL) {
+        return;
+    }
+
+    state_update();
+    munmap(g_state, sizeof(*g_state));
+    g_state = NULL;
+    g_current = NULL;
+}
@@ -0,0 +1,77 @@
+/*
+################################################################################
+#
+#  Copyright 2020-2021 Inango Systems Ltd.
+#
+#  Licensed under the Apache License, Version 2.0 (the "License");
+#  you may not use this file except in compliance with the License.
+#  You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+#  Unless required by applicable law or agreed to in writing, software
+#  distributed under the License is distributed on an "AS IS" BASIS,
+#  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+#  See the License for the specific language governing permissions and
+#  limitations under the License.
+#
+################################################################################
+*/
+#ifndef CHANDLER_STATE_H
+#define CHANDLER_STATE_H
+
+#include "chandler_stat.h"
+
+#include <stdint.h>
+
+#define STATE_MAGIC       0x444e4843u   // "CHND"
+#define STATE_VERSION     1
+#define BOOT_ID_SIZE      40
+#define BOOT_ID_PATH      "/proc/sys/kernel/random/boot_id"
+
+/*
+ * The state file keeps statistics across restarts of chandler and reboots
+ * of the system. It is mapped into memory and holds two copies (slots) of
+ * the state: the older one is overwritten on every update, so a crash in
+ * the middle of an update leaves the other slot intact. A slot is valid if
+ * its checksum matches, the one with the highest sequence number is used.
+ */
+typedef struct state_slot_t {
+    uint64_t         seq;                    // sequence number of the update
+    char             boot_id[BOOT_ID_SIZE];  // boot id of the system which has written the slot
+    chandler_stat_t  stat;
+    uint32_t         crc;                    // CRC32 of all fields above
+} state_slot_t;
+
+typedef struct state_file_t {
+    uint32_t      magic;
+    uint32_t      version;                   // changes with layout of state_slot_t
+    uint32_t      slot_size;
+    uint32_t      reserved;
+    state_slot_t  slots[2];
+} state_file_t;
+
+/**
+ * Maps the state file, creating it if needed, and loads statistics from the
+ * newest valid slot. A new boot of the system is counted if the boot id
+ * differs from the stored one. A file of another version is reset.
+ *
+ * \param path  Path to the state file (empty string - state is not kept)
+ *
+ * \return      0 - on success, errno - on failure
+ */
+int  state_open(const char * path);
+
+/**
+ * Writes statistics to the state file if they have been changed since the
+ * previous update. Data is synced to the disk, so the function can be
+ * called right before a reboot.
+ */
+void state_update(void);
+
+/**
+ * Updates and unmaps the state file.
+ */
+void state_close(void);
+
+#endif  /* CHANDLER_STATE_H */
@@ -22,6 +22,7 @@
 #include <dirent.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <signal.h>
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -29,8 +30,10 @@
 #include <sys/reboot.h>
 #include <sys/stat.h>
 #include <sys/socket.h>
+#include <sys/syscall.h>
 #include <sys/timerfd.h>
 #include <sys/un.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "chandler_log.h"
@@ -189,10 +192,44 @@ int connect_unix_socket(int style, const char * path, int * fd)
     return 0;
 }
 
+int listen_unix_socket(const char * path, int * fd)
+{
+    struct sockaddr_un un;
+    socklen_t          un_len;
+    int                error;
+
+    *fd = socket(PF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (*fd < 0) {
+        LOG_ERROR("failed to create unix socket: %d (%s)", errno, strerror(errno));
+        return errno;
+    }
+
+    error = make_sockaddr_un(path, &un, &un_len);
+    if (error) {
+        LOG_ERROR("failed to initialize sockaddr_un for path \"%s\": %d (%s)", path, error, strerror(error));
+        close(*fd);
+        return error;
+    }
+
+    /* remove a stale socket left by the previous instance */
+    unlink(path);
+
+    if (0 != bind(*fd, (struct sockaddr *)&un, un_len) || 0 != listen(*fd, SOMAXCONN))
+    {
+        error = errno;
+        LOG_ERROR("failed to listen on \"%s\": %d (%s)", path, error, strerror(error));
+        close(*fd);
+        return error;
+    }
+
+    return 0;
+}
+
 int spawn_process(const char * path, char * const * args)
 {
-    pid_t fork_pid = fork();
-    int   rc;
+    pid_t    fork_pid = fork();
+    int      rc;
+    sigset_t mask;
 
     if (fork_pid == 0) {
         /* a child process */
@@ -204,6 +241,10 @@ int spawn_process(const char * path, char * const * args)
             close(x);
         }
 
+        /* signals handled by chandler via signalfd are blocked and the mask survives exec */
+        sigemptyset(&mask);
+        sigprocmask(SIG_SETMASK, &mask, NULL);
+
         rc = execv(path, args);
         if (rc == -1) {
             fprintf(stderr, "forked child failed to exec: errno = %d", errno);
@@ -222,31 +263,155 @@ int spawn_process(const char * path, char * const * args)
     return 0;
 }
 
-int spawn_process_from_command(const char * command_line) {
-    char  cmd[MAX_COMMAND_SIZE];
-    char *args[MAX_COMMAND_ARGS + 1];
+pid_t spawn_shell(const char * command, int * output_fd)
+{
+    int      fds[2];
+    pid_t    pid;
+    sigset_t mask;
+
+    if (pipe2(fds, O_CLOEXEC) != 0) {
+        LOG_ERROR("failed to create pipe: errno = %d", errno);
+        return -1;
+    }
+
+    pid = fork();
+    if (pid == 0) {
+        /* a child process: stdout goes to the pipe, descriptors of chandler are closed on exec */
+        dup2(fds[1], STDOUT_FILENO);
+        setpgid(0, 0);
+
+        sigemptyset(&mask);
+        sigprocmask(SIG_SETMASK, &mask, NULL);
+
+        execl("/bin/sh", "sh", "-c", command, (char *)NULL);
+        _exit(127);
+    }
+
+    close(fds[1]);
+
+    if (pid == -1) {
+        LOG_ERROR("failed to fork: errno = %d", errno);
+        close(fds[0]);
+        return -1;
+    }
+
+    *output_fd = fds[0];
+    return pid;
+}
+
+/* Splits the command line into args in place, options listed in skip are dropped. Safe to call in a forked child */
+static int split_command(char * cmd, char ** args, const char * const * skip)
+{
     char *save_ptr = NULL;
     char *arg;
     int   count = 0;
+    int   is_skipped;
 
-    strncpy(cmd, command_line, sizeof(cmd));
     arg = strtok_r(cmd, " ", &save_ptr);
     for (; arg != NULL && count < MAX_COMMAND_ARGS; arg = strtok_r(NULL, " ", &save_ptr)) {
-        LOG_DBG("-- arg[%d] = %s", count, arg);
+        is_skipped = 0;
+        for (int i = 0; skip != NULL && skip[i] != NULL; ++i) {
+            is_skipped |= (0 == strcmp(arg, skip[i]));
+        }
+
+        if (is_skipped) {
+            continue;
+        }
+
         args[count] = arg;
         ++count;
     }
 
     if (arg && count == MAX_COMMAND_ARGS) {
-        LOG_ERROR("too many arguments in command (> %d): %s", MAX_COMMAND_ARGS, command_line);
         return -1;
     }
 
     args[count] = NULL;
+    return count;
+}
+
+int spawn_process_from_command(const char * command_line) {
+    char  cmd[MAX_COMMAND_SIZE];
+    char *args[MAX_COMMAND_ARGS + 1];
+
+    strncpy(cmd, command_line, sizeof(cmd) - 1);
+    cmd[sizeof(cmd) - 1] = '\0';
+
+    if (split_command(cmd, args, NULL) < 0) {
+        LOG_ERROR("too many arguments in command (> %d): %s", MAX_COMMAND_ARGS, command_line);
+        return -1;
+    }
+
+    for (int i = 0; args[i] != NULL; ++i) {
+        LOG_DBG("-- arg[%d] = %s", i, args[i]);
+    }
 
     return spawn_process(args[0], args);
 }
 
+int open_output_pipe(int fds[2])
+{
+    if (pipe2(fds, O_CLOEXEC) != 0) {
+        LOG_ERROR("failed to create pipe: errno = %d", errno);
+        return -1;
+    }
+
+    /* only chandler's end is non-blocking, the daemon may block on a full pipe */
+    fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+    return 0;
+}
+
+void exec_command(const char * command_line, int output_fd, int is_foreground)
+{
+    static const char * const detach_options[] = {"--detach", "--monitor", NULL};
+
+    char      cmd[MAX_COMMAND_SIZE];
+    char     *args[MAX_COMMAND_ARGS + 1];
+    sigset_t  mask;
+    int       first_fd = 0;
+
+    strncpy(cmd, command_line, sizeof(cmd) - 1);
+    cmd[sizeof(cmd) - 1] = '\0';
+
+    if (output_fd >= 0) {
+        dup2(output_fd, STDOUT_FILENO);
+        dup2(output_fd, STDERR_FILENO);
+        first_fd = STDERR_FILENO + 1;
+    }
+
+    if (is_foreground) {
+        setpgid(0, 0);
+    }
+
+    for (int x = (int)sysconf(_SC_OPEN_MAX); x >= first_fd; --x) {
+        close(x);
+    }
+
+    if (split_command(cmd, args, is_foreground? detach_options: NULL) <= 0) {
+        fprintf(stderr, "invalid command (empty or more than %d arguments): %s\n", MAX_COMMAND_ARGS, command_line);
+        _exit(127);
+    }
+
+    /* signals handled by chandler via signalfd are blocked and the mask survives exec */
+    sigemptyset(&mask);
+    sigprocmask(SIG_SETMASK, &mask, NULL);
+
+    execv(args[0], args);
+    fprintf(stderr, "forked child failed to exec: errno = %d\n", errno);
+    _exit(127);
+}
+
+int process_open_fd(pid_t pid)
+{
+#ifdef SYS_pidfd_open
+    return (int)syscall(SYS_pidfd_open, pid, 0);
+#else
+    (void)pid;
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
 int system_reboot(void)
 {
     sync();
@@ -258,3 +423,52 @@ int system_reboot(void)
 
     return reboot(RB_AUTOBOOT);
 }
+
+uint64_t time_monotonic_usec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+uint64_t time_realtime_usec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+int time_in_window(const char * window)
+{
+    struct tm tm;
+    time_t    now;
+    int       start_hour, start_min, end_hour, end_min;
+    int       start, end, current;
+
+    if (window[0] == '\0') {
+        return 1;
+    }
+
+    if (4 != sscanf(window, "%d:%d-%d:%d", &start_hour, &start_min, &end_hour, &end_min)
+        || start_hour < 0 || start_hour > 23 || start_min < 0 || start_min > 59
+        || end_hour < 0 || end_hour > 24 || end_min < 0 || end_min > 59)
+    {
+        return -1;
+    }
+
+    now = time(NULL);
+    localtime_r(&now, &tm);
+
+    start   = start_hour * 60 + start_min;
+    end     = end_hour * 60 + end_min;
+    current = tm.tm_hour * 60 + tm.tm_min;
+
+    /* window crossing midnight, like "23:00-02:00" */
+    if (end < start) {
+        return current >= start || current < end;
+    }
+
+    return current >= start && current < end;
+}
@@ -21,6 +21,7 @@
 #define CHANDLER_SYSTEM_H
 
 #include <fcntl.h>
+#include <stdint.h>
 #include <sys/wait.h>
 #include <wchar.h>
 
@@ -28,6 +29,7 @@
 #define MAX_PATH_SIZE         256
 #define MAX_COMMAND_SIZE      1024
 #define MAX_COMMAND_ARGS      16
+#define MAX_POLICY_SIZE       64
 #define MAX_REQUEST_SIZE      32768
 #define MAX_RESPONSE_SIZE     32768
 #define MAX_ADDR_SIZE         128
@@ -35,9 +37,36 @@
 #define MAX_BR_NAME_SIZE      64
 #define MAX_IF_NAME_SIZE      64
 #define MAX_ENV_VALUE_SIZE    128
+#define MAX_ESCALATION_SIZE   256
+#define MAX_SERVICES          8
+#define MAX_METHOD_SIZE       64
+#define MAX_WINDOW_SIZE       16
 
 #define CHECK_INTERVAL_MSEC   60000
+#define RECHECK_INTERVAL_MSEC 1000
+#define CHECK_JITTER_PERCENT  10
 #define RECV_TIMEOUT_MSEC     15000
+#define RECV_TIMEOUT_MIN_MSEC 100
+#define RTT_PERCENTILE        99
+#define RTT_FACTOR            5
+#define DEADLINE_MISSES       3
+#define SLOW_EWMA_MSEC        0
+#define SLOW_PERCENTILE_MSEC  0
+#define ECHO_INTERVAL_MSEC    5000
+#define HOOK_TIMEOUT_MSEC     60000
+#define REBOOT_WINDOW_MSEC    3600000
+#define BACKOFF_MIN_MSEC      1000
+#define BACKOFF_MAX_MSEC      300000
+#define MAX_REBOOTS           3
+#define ESCALATION_WINDOW_MSEC 300000
+#define STARTUP_GRACE_MSEC    30000
+#define STARTUP_POLL_MSEC     100
+#define KILL_TIMEOUT_MSEC     5000
+#define SUPERVISE_CHILDREN    0
+#define SAMPLE_INTERVAL_MSEC  10000
+#define BUSY_PERCENT          95
+#define BUSY_WINDOW_MSEC      30000
+#define STUCK_TIMEOUT_MSEC    60000
 
 
 typedef enum query_status_t {
@@ -59,14 +88,76 @@ pid_t   read_pid_from_file(const char * pid_file);
 
 int     connect_unix_socket(int style, const char * path, int * fd);
 
+int     listen_unix_socket(const char * path, int * fd);
+
 int     spawn_process(const char * path, char * const * args);
 
 int     spawn_process_from_command(const char * command_line);
 
+/**
+ * Runs the command with "/bin/sh -c" like popen() does, but with the signal
+ * mask reset, so the command does not inherit signals blocked for signalfd.
+ * The shell becomes a process group leader, so the whole command can be
+ * killed with kill(-pid, ...).
+ *
+ * \param command         Shell command line
+ * \param[out] output_fd  Read end of the pipe connected to stdout of the command
+ *
+ * \return                Pid of the shell, -1 - on error
+ */
+pid_t   spawn_shell(const char * command, int * output_fd);
+
+/**
+ * Creates a pipe for output of a spawned daemon. Both ends are closed on
+ * exec, the read end is non-blocking.
+ *
+ * \param[out] fds  Read and write ends of the pipe
+ *
+ * \return          0 - on success, -1 - on error
+ */
+int     open_output_pipe(int fds[2]);
+
+/**
+ * Replaces image of a forked process with the command. Descriptors are
+ * closed and the signal mask is reset. Never returns.
+ *
+ * \param command_line   Command line, arguments are separated by spaces
+ * \param output_fd      Descriptor stdout and stderr are redirected to (-1 - none)
+ * \param is_foreground  1 - options "--detach" and "--monitor" are dropped
+ *                       from the command and the process gets its own
+ *                       process group, 0 - command is run as is
+ */
+void    exec_command(const char * command_line, int output_fd, int is_foreground);
+
+/**
+ * Opens a pidfd of the process. It becomes readable when the process exits,
+ * the process does not have to be a child.
+ *
+ * \param pid  Pid of the process
+ *
+ * \return     File descriptor, -1 - on error (errno is set)
+ */
+int     process_open_fd(pid_t pid);
+
 int     timer_create_repeated(long interval_msec);
 
 int     timer_destroy(int fd);
 
 int     system_reboot(void);
 
+uint64_t time_monotonic_usec(void);
+
+/* Wall clock time in usec, comparable across reboots */
+uint64_t time_realtime_usec(void);
+
+/**
+ * Checks that the local time is within the daily window.
+ *
+ * \param window  "HH:MM-HH:MM", the end may be less than the start for windows
+ *                crossing midnight (empty - any time)
+ *
+ * \return        1 - time is within the window, 0 - it is not, -1 - invalid window
+ */
+int     time_in_window(const char * window);
+
 #endif  /* CHANDLER_SYSTEM_H */
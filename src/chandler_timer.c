@@ -0,0 +1,331 @@
+/*
+################################################################################
+#
+#  Copyright 2020-2021 Inango Systems Ltd.
+#
+#  Licensed under the Apache License, Version 2.0 (the "License");
+#  you may not use this file except in compliance with the License.
+#  You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+#  Unless required by applicable law or agreed to in writing, software
+#  distributed under the License is distributed on an "AS IS" BASIS,
+#  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+#  See the License for the specific language governing permissions and
+#  limitations under the License.
+#
+################################################################################
+*/
+#define _GNU_SOURCE
+
+#include "chandler_timer.h"
+
+#include "chandler_log.h"
+#include "chandler_loop.h"
+#include "chandler_system.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+
+#define NO_TICK  UINT64_MAX
+
+
+typedef struct timer_wheel_t {
+    int            fd;
+    uint64_t       current;                              // last processed tick
+    uint64_t       armed;                                // tick the timerfd is armed to (NO_TICK - disarmed)
+    uint64_t       occupied[WHEEL_LEVELS];               // bitmap of non-empty slots of each level
+    wheel_timer_t  slots[WHEEL_LEVELS * WHEEL_SLOTS];    // list heads
+} timer_wheel_t;
+
+
+static timer_wheel_t g_wheel = {.fd = -1};
+
+
+static uint64_t now_tick(void)
+{
+    return time_monotonic_usec() / 1000;
+}
+
+static unsigned level_shift(int level)
+{
+    return (unsigned)(level * WHEEL_SLOT_BITS);
+}
+
+static void list_init(wheel_timer_t * head)
+{
+    head->next = head;
+    head->prev = head;
+}
+
+static int list_is_empty(const wheel_timer_t * head)
+{
+    return head->next == head;
+}
+
+static void list_append(wheel_timer_t * head, wheel_timer_t * timer)
+{
+    timer->prev       = head->prev;
+    timer->next       = head;
+    head->prev->next  = timer;
+    head->prev        = timer;
+}
+
+/* Moves all timers of the slot to the empty list head */
+static void list_splice(wheel_timer_t * slot, wheel_timer_t * head)
+{
+    if (list_is_empty(slot)) {
+        list_init(head);
+        return;
+    }
+
+    head->next       = slot->next;
+    head->prev       = slot->prev;
+    head->next->prev = head;
+    head->prev->next = head;
+    list_init(slot);
+}
+
+/*
+ * Timer goes to the lowest level where its slot is less than a full turn
+ * ahead of the current one, i.e. it can't be confused with a slot which has
+ * already been passed. Returns the tick when the slot has to be processed.
+ */
+static uint64_t wheel_insert(wheel_timer_t * timer)
+{
+    int      level;
+    unsigned shift = 0;
+    int      index;
+
+    for (level = 0; level < WHEEL_LEVELS - 1; ++level) {
+        shift = level_shift(level);
+        if ((timer->expires >> shift) - (g_wheel.current >> shift) < WHEEL_SLOTS) {
+            break;
+        }
+    }
+
+    shift = level_shift(level);
+    index = (int)((timer->expires >> shift) & (WHEEL_SLOTS - 1));
+
+    timer->slot = level * WHEEL_SLOTS + index;
+    list_append(&g_wheel.slots[timer->slot], timer);
+    g_wheel.occupied[level] |= (uint64_t)1 << index;
+
+    return (timer->expires >> shift) << shift;
+}
+
+static void wheel_unlink(wheel_timer_t * timer)
+{
+    timer->prev->next = timer->next;
+    timer->next->prev = timer->prev;
+    timer->next = NULL;
+    timer->prev = NULL;
+
+    if (timer->slot >= 0 && list_is_empty(&g_wheel.slots[timer->slot])) {
+        g_wheel.occupied[timer->slot / WHEEL_SLOTS] &= ~((uint64_t)1 << (timer->slot % WHEEL_SLOTS));
+    }
+}
+
+static uint64_t rotate_right(uint64_t value, unsigned count)
+{
+    count &= 63;
+    return count? (value >> count) | (value << (64 - count)): value;
+}
+
+/* Returns the nearest tick after the current one when some slot has to be processed */
+static uint64_t wheel_next_tick(void)
+{
+    uint64_t next = NO_TICK;
+    uint64_t first;
+    uint64_t tick;
+    unsigned shift;
+
+    for (int level = 0; level < WHEEL_LEVELS; ++level) {
+        if (g_wheel.occupied[level] == 0) {
+            continue;
+        }
+
+        /* slots are scanned starting from the one following the current */
+        shift = level_shift(level);
+        first = (g_wheel.current >> shift) + 1;
+        tick  = (first + (uint64_t)__builtin_ctzll(rotate_right(g_wheel.occupied[level], (unsigned)(first & (WHEEL_SLOTS - 1))))) << shift;
+
+        if (tick < next) {
+            next = tick;
+        }
+    }
+
+    return next;
+}
+
+static void wheel_arm(uint64_t tick)
+{
+    struct itimerspec tsp = {{0, 0}, {0, 0}};
+
+    if (tick != NO_TICK) {
+        tsp.it_value.tv_sec  = (time_t)(tick / 1000);
+        tsp.it_value.tv_nsec = (long)(tick % 1000) * 1000000;
+    }
+
+    if (timerfd_settime(g_wheel.fd, TFD_TIMER_ABSTIME, &tsp, NULL) != 0) {
+        LOG_ERROR("failed to arm timer wheel: %d (%s)", errno, strerror(errno));
+        return;
+    }
+
+    g_wheel.armed = tick;
+}
+
+/* Moves timers of a higher level slot down to lower levels */
+static void wheel_cascade(int level, uint64_t tick)
+{
+    wheel_timer_t  head;
+    wheel_timer_t *timer;
+    int            index = (int)((tick >> level_shift(level)) & (WHEEL_SLOTS - 1));
+
+    list_splice(&g_wheel.slots[level * WHEEL_SLOTS + index], &head);
+    g_wheel.occupied[level] &= ~((uint64_t)1 << index);
+
+    while (!list_is_empty(&head)) {
+        timer = head.next;
+        head.next = timer->next;
+        timer->next->prev = &head;
+        wheel_insert(timer);
+    }
+}
+
+static void wheel_process(uint64_t tick)
+{
+    wheel_timer_t  head;
+    wheel_timer_t *timer;
+    int            index = (int)(tick & (WHEEL_SLOTS - 1));
+
+    g_wheel.current = tick;
+
+    for (int level = WHEEL_LEVELS - 1; level > 0; --level) {
+        if ((tick & (((uint64_t)1 << level_shift(level)) - 1)) == 0) {
+            wheel_cascade(level, tick);
+        }
+    }
+
+    /* handlers may start and cancel timers, including the ones of this slot */
+    list_splice(&g_wheel.slots[index], &head);
+    g_wheel.occupied[0] &= ~((uint64_t)1 << index);
+
+    for (timer = head.next; timer != &head; timer = timer->next) {
+        timer->slot = -1;
+    }
+
+    while (!list_is_empty(&head)) {
+        timer = head.next;
+        wheel_unlink(timer);
+        timer->handler(timer->ctx);
+    }
+}
+
+static void on_wheel_fd(int fd, uint32_t events, void * ctx)
+{
+    uint64_t expirations;
+    uint64_t now = now_tick();
+    uint64_t tick;
+
+    (void)events;
+    (void)ctx;
+
+    if (read(fd, &expirations, sizeof(expirations)) < 0 && errno != EAGAIN) {
+        LOG_ERROR("failed to reset timer wheel descriptor: %d (%s)", errno, strerror(errno));
+    }
+
+    /* empty slots are skipped: there is nothing to cascade or fire in them */
+    while ((tick = wheel_next_tick()) <= now) {
+        wheel_process(tick);
+    }
+
+    if (now > g_wheel.current) {
+        g_wheel.current = now;
+    }
+
+    wheel_arm(wheel_next_tick());
+}
+
+int wheel_init(void)
+{
+    int error;
+
+    for (int i = 0; i < WHEEL_LEVELS * WHEEL_SLOTS; ++i) {
+        list_init(&g_wheel.slots[i]);
+    }
+
+    memset(g_wheel.occupied, 0, sizeof(g_wheel.occupied));
+    g_wheel.current = now_tick();
+    g_wheel.armed   = NO_TICK;
+
+    g_wheel.fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (g_wheel.fd == -1) {
+        LOG_ERROR("failed to create timerfd: %d (%s)", errno, strerror(errno));
+        return errno;
+    }
+
+    error = loop_add_fd(g_wheel.fd, EPOLLIN, on_wheel_fd, NULL);
+    if (error) {
+        close(g_wheel.fd);
+        g_wheel.fd = -1;
+    }
+
+    return error;
+}
+
+void wheel_done(void)
+{
+    if (g_wheel.fd != -1) {
+        loop_del_fd(g_wheel.fd);
+        close(g_wheel.fd);
+        g_wheel.fd = -1;
+    }
+}
+
+void wheel_timer_start(wheel_timer_t * timer, long delay_msec, wheel_handler_t handler, void * ctx)
+{
+    uint64_t tick;
+
+    if (timer->next != NULL) {
+        wheel_unlink(timer);
+    }
+
+    if (delay_msec < 1) {
+        delay_msec = 1;
+    }
+    else if (delay_msec > WHEEL_MAX_DELAY_MSEC) {
+        delay_msec = WHEEL_MAX_DELAY_MSEC;
+    }
+
+    /* the wheel may lag behind the clock while handlers are running */
+    timer->expires = now_tick() + (uint64_t)delay_msec;
+    if (timer->expires - g_wheel.current > (uint64_t)WHEEL_MAX_DELAY_MSEC) {
+        timer->expires = g_wheel.current + (uint64_t)WHEEL_MAX_DELAY_MSEC;
+    }
+
+    timer->handler = handler;
+    timer->ctx     = ctx;
+
+    tick = wheel_insert(timer);
+    if (tick < g_wheel.armed) {
+        wheel_arm(tick);
+    }
+}
+
+void wheel_timer_cancel(wheel_timer_t * timer)
+{
+    /* the timerfd is left armed: a spurious wakeup is cheaper than a rescan */
+    if (timer->next != NULL) {
+        wheel_unlink(timer);
+    }
+}
+
+int wheel_timer_is_pending(const wheel_timer_t * timer)
+{
+    return timer->next != NULL;
+}
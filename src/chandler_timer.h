@@ -0,0 +1,81 @@
+/*
+################################################################################
+#
+#  Copyright 2020-2021 Inango Systems Ltd.
+#
+#  Licensed under the Apache License, Version 2.0 (the "License");
+#  you may not use this file except in compliance with the License.
+#  You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+#  Unless required by applicable law or agreed to in writing, software
+#  distributed under the License is distributed on an "AS IS" BASIS,
+#  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+#  See the License for the specific language governing permissions and
+#  limitations under the License.
+#
+################################################################################
+*/
+#ifndef CHANDLER_TIMER_H
+#define CHANDLER_TIMER_H
+
+#include <stdint.h>
+
+/*
+ * Hierarchical timer wheel with 1 msec tick: level N has 64 slots of 64^N
+ * ticks each, so 5 levels cover delays up to ~12 days. Timers are kept in
+ * intrusive lists, so start and cancel are O(1) and never allocate memory.
+ * The wheel is driven by a single timerfd which is always armed to the
+ * nearest slot that has to be processed.
+ */
+#define WHEEL_LEVELS          5
+#define WHEEL_SLOT_BITS       6
+#define WHEEL_SLOTS           (1 << WHEEL_SLOT_BITS)
+#define WHEEL_MAX_DELAY_MSEC  ((long)(WHEEL_SLOTS - 1) << (WHEEL_SLOT_BITS * (WHEEL_LEVELS - 1)))
+
+typedef void (* wheel_handler_t)(void * ctx);
+
+/* Storage of a timer is owned by the user; it should be zero-initialized before the first start */
+typedef struct wheel_timer_t {
+    struct wheel_timer_t *next;        // NULL - timer is not pending
+    struct wheel_timer_t *prev;
+    uint64_t              expires;     // tick of expiration
+    int                   slot;        // index of the wheel slot, -1 - timer is being fired
+    wheel_handler_t       handler;
+    void                 *ctx;
+} wheel_timer_t;
+
+/**
+ * Creates the timerfd and registers it in the event loop.
+ *
+ * \return  0 on success, errno value - otherwise
+ */
+int  wheel_init(void);
+
+/**
+ * Unregisters and closes the timerfd. Pending timers are forgotten.
+ */
+void wheel_done(void);
+
+/**
+ * Starts (or restarts) a one-shot timer.
+ *
+ * \param timer       Timer storage
+ * \param delay_msec  Delay from now, clamped to [1, WHEEL_MAX_DELAY_MSEC]
+ * \param handler     Handler called from the event loop on expiration
+ * \param ctx         Context passed to the handler
+ */
+void wheel_timer_start(wheel_timer_t * timer, long delay_msec, wheel_handler_t handler, void * ctx);
+
+/**
+ * Cancels the timer if it is pending. It is safe to call from any handler.
+ */
+void wheel_timer_cancel(wheel_timer_t * timer);
+
+/**
+ * Returns 1 if the timer is started and has not expired yet.
+ */
+int  wheel_timer_is_pending(const wheel_timer_t * timer);
+
+#endif  /* CHANDLER_TIMER_H */